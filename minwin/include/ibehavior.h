@@ -28,6 +28,8 @@ class IKeyBehavior
     virtual void on_press() const = 0;
     //! Action executed when the key is released.
     virtual void on_release() const = 0;
+    //! Declared last so that the slots of on_press() and on_release() do not move.
+    virtual ~IKeyBehavior() {};
 };
 
 } // end of namespace minwin
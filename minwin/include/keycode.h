@@ -6,6 +6,11 @@
 //! \author    Tiago de Lima <tiago.delima@univ.artois.fr>
 //!
 
+#ifndef _MINWIN_KEYCODE_H_
+#define _MINWIN_KEYCODE_H_
+
+#include "SDL2/SDL.h"
+
 namespace minwin {
 
 //! Keyboard key codes.
@@ -48,3 +53,5 @@ static constexpr KeyCode KEY_SPACE = SDLK_SPACE;
 static constexpr KeyCode KEY_UP = SDLK_UP;
 
 } // end of namespace minwin
+
+#endif // _MINWIN_KEYCODE_H_
@@ -73,6 +73,11 @@ class Window
     void put_pixel( int posX, int posY ) const;
     void put_pixel( int posX, int posY, const Color & ) const;
 
+    // Whole-frame pixel buffers (RGBA32, one streaming texture upload per frame).
+    SDL_Texture * create_buffer_texture( unsigned int w, unsigned int h ) const;
+    void put_buffer( SDL_Texture * texture, const Uint32 * pixels, int posX, int posY ) const;
+    void destroy_buffer_texture( SDL_Texture * texture ) const;
+
   private:
     SDL_Window *   window   { nullptr };
     SDL_Renderer * renderer { nullptr };
@@ -122,6 +127,42 @@ class Window
     //void update_delta_time();
 };
 
+//
+// Pixel buffer helpers. They are defined inline (and do not add any data member) so
+// that they work with an already built MinWin library.
+//
+
+//! Creates a streaming texture able to receive a w x h RGBA32 pixel buffer.
+//! The caller owns the texture (see destroy_buffer_texture()).
+inline SDL_Texture * Window::create_buffer_texture( unsigned int w, unsigned int h ) const
+{
+  SDL_Texture * texture = SDL_CreateTexture( renderer, SDL_PIXELFORMAT_ABGR8888,
+                                             SDL_TEXTUREACCESS_STREAMING, w, h );
+  if( texture != nullptr )
+    SDL_SetTextureBlendMode( texture, SDL_BLENDMODE_NONE );
+  return texture;
+}
+
+//! Uploads a whole pixel buffer (same size as the texture) and copies it on the
+//! window surface, with its top left corner at (posX, posY).
+inline void Window::put_buffer( SDL_Texture * texture, const Uint32 * pixels, int posX, int posY ) const
+{
+  int w, h;
+  if( texture == nullptr || SDL_QueryTexture( texture, nullptr, nullptr, &w, &h ) != 0 )
+    return;
+
+  SDL_UpdateTexture( texture, nullptr, pixels, w * sizeof( Uint32 ) );
+  SDL_Rect dst { posX, posY, w, h };
+  SDL_RenderCopy( renderer, texture, nullptr, &dst );
+}
+
+//! Frees a texture created by create_buffer_texture().
+inline void Window::destroy_buffer_texture( SDL_Texture * texture ) const
+{
+  if( texture != nullptr )
+    SDL_DestroyTexture( texture );
+}
+
 } // end of namespace minwin
 
 #endif // _MINWIN_WINDOW_H_
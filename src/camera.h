@@ -1,4 +1,5 @@
 #include "matrix.h"
+#include "quaternion.h"
 
 #define DEFAULT_MOVE_SPEED 0.5
 #define DEFAULT_ROT_SPEED 1
@@ -22,6 +23,29 @@ public:
         this->bot = aline::Vec4r({0.0, -2.0, -1.0, 0.0});
     }
 
+    // The frustum seen through the projection matrix m, in the coordinates m transforms
+    // (world coordinates for a view-projection matrix). Each plane keeps the points p
+    // (with p[3] = 1) such that dot(plane, p) >= 0. The projection must map the visible
+    // points to -w <= x, y <= w and 0 <= z <= w, with z = w on the near plane (as Scene
+    // does, with z the reciprocal of the depth, so the far plane is at infinity).
+    Frustum(const aline::Mat44r &m){
+        aline::Vec4r x = m[0], y = m[1], z = m[2], w = m[3];
+        this->near = w - z;
+        this->dist = z;
+        this->left = w + x;
+        this->right = w - x;
+        this->top = w - y;
+        this->bot = w + y;
+    }
+
+    // Copies the planes (near, far, left, right, top and bottom) into an array.
+    void get_planes(aline::real (&planes)[6][4]) const{
+        const aline::Vec4r *all[6] = {&near, &dist, &left, &right, &top, &bot};
+        for (int p = 0; p < 6; ++p)
+            for (int k = 0; k < 4; ++k)
+                planes[p][k] = (*all[p])[k];
+    }
+
     aline::Vec4r get_near(){
         return near;
     }
@@ -51,15 +75,18 @@ class Camera {
     aline::real aspect_ratio, focal_dist, move_speed, rot_speed;
     //, zoom_speed;
     aline::Vec4r position;
-    aline::Vec3r orientation, translation, rotation;
+    aline::Quaternion orientation; // rotation from the camera's axes to the world axes
+    aline::Vec3r translation, rotation;
+    aline::Quaternion rotation_step; // rotation of one update() while rotating
     Frustum frustum;
+    mutable aline::Mat44r view_matrix; // cached transform matrix
+    mutable bool dirty;                // true if view_matrix is out of date
     
 public:
 
-    Camera(aline::real aspect_ratio) : aspect_ratio(aspect_ratio), frustum(Frustum(0.1, 5.0))
+    Camera(aline::real aspect_ratio) : aspect_ratio(aspect_ratio), frustum(Frustum(0.1, 5.0)), dirty(true)
     {
         focal_dist = 2.0;
-        orientation = {0.0, 0.0, 0.0};
         position = {0.0, 0.0, 0.0, 1.0};
         move_speed = 0;
         rot_speed = 0;
@@ -94,10 +121,25 @@ public:
         return position;
     }
 
-    aline::Vec3r get_orientation(){
+    const aline::Quaternion& get_orientation(){
         return orientation;
     }
 
+    void set_position(const aline::Vec4r &position){
+        this->position = position;
+        dirty = true;
+    }
+
+    void set_orientation(const aline::Quaternion &orientation){
+        this->orientation = orientation;
+        dirty = true;
+    }
+
+    // Tests if the camera moved since its transform matrix was last built.
+    bool is_dirty() const{
+        return dirty;
+    }
+
     void move_forward(uint axis){
         move_speed = DEFAULT_MOVE_SPEED;
         translation[axis] = 1.0;
@@ -111,11 +153,13 @@ public:
     void rotate_cw(uint axis){
         rot_speed = DEFAULT_ROT_SPEED;
         rotation[axis] = 1.0;
+        update_rotation_step();
     }
 
     void rotate_acw(uint axis){
         rot_speed = -DEFAULT_ROT_SPEED;
         rotation[axis] = 1.0;
+        update_rotation_step();
     }
 
     void stop_movement(uint axis){
@@ -126,38 +170,52 @@ public:
     void stop_rotation(uint axis){
         rot_speed = 0;
         rotation[axis] = 0.0;
+        update_rotation_step();
     }
 
-    aline::Mat44r transform() const {
-        aline::Mat44r translation_matrix({
-            {1.0, 0.0, 0.0, -position[0]},
-            {0.0, 1.0, 0.0, -position[1]},
-            {0.0, 0.0, 1.0, -position[2]},
-            {0.0, 0.0, 0.0, 1.0}
-        });
-
-        aline::real alpha = degrees_to_radians(orientation[0]);
-        aline::real beta = degrees_to_radians(orientation[1]);
-        aline::real gamma = degrees_to_radians(orientation[2]);
-        aline::Mat44r rotation_matrix({
-            {cos(beta)*cos(gamma), cos(beta)*sin(gamma), -sin(beta), 0.0},
-            {sin(alpha)*sin(beta)*cos(gamma)-cos(alpha)*sin(gamma), sin(alpha)*sin(beta)*sin(gamma)+cos(alpha)*cos(gamma), sin(alpha)*cos(beta), 0.0},
-            {cos(alpha)*sin(beta)*cos(gamma)+sin(alpha)*sin(gamma), cos(alpha)*sin(beta)*sin(gamma)-sin(alpha)*cos(gamma), cos(alpha)*cos(beta), 0.0},
-            {0.0, 0.0, 0.0, 1.0}
-        });
-
-        return translation_matrix * inverse(rotation_matrix);
+    // Returns the view matrix, rebuilt only if the camera moved since the last call.
+    const aline::Mat44r& transform() const {
+        if (dirty){
+            view_matrix = build_transform();
+            dirty = false;
+        }
+        return view_matrix;
     }
 
     void update(){
-        aline::Vec3r temp = translation * move_speed;
-        aline::Vec4r trans = {temp[0], temp[1], temp[2], 0.0};
-        position = position + trans; 
+        if (move_speed != 0){
+            // move along the camera's own axes
+            aline::Vec3r temp = aline::rotate(orientation, translation * move_speed);
+            aline::Vec4r trans = {temp[0], temp[1], temp[2], 0.0};
+            position = position + trans; 
+            dirty = true;
+        }
 
-        orientation += (rotation * rot_speed);
+        if (rot_speed != 0){
+            // rotation around the camera's own axes
+            orientation = aline::normalize(orientation * rotation_step);
+            dirty = true;
+        }
     }
 
 private:
+    aline::Mat44r build_transform() const {
+        // the view matrix is the inverse of the (rigid) placement of the camera: translates
+        // by -position, then rotates around the camera
+        aline::Mat44r placement = aline::to_matrix44(orientation);
+        placement[0][3] = position[0];
+        placement[1][3] = position[1];
+        placement[2][3] = position[2];
+        return inverse_rigid(placement);
+    }
+
+    // Computes, when the rotation keys change, the rotation applied by each update():
+    // rot_speed degrees around each axis in rotation.
+    void update_rotation_step(){
+        aline::Vec3r angles = rotation * degrees_to_radians(rot_speed);
+        rotation_step = aline::conjugate(aline::Quaternion::from_euler_angles(angles[0], angles[1], angles[2]));
+    }
+
     aline::real degrees_to_radians(aline::real x) const{
         return x * (M_PI / 180);
     }
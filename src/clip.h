@@ -0,0 +1,107 @@
+#include <cstdint>
+#include <utility>
+#include "vector.h"
+
+#ifndef CLIP_H
+
+#define CLIP_H
+
+// Half size of the guard band, relative to the view: triangles are only clipped against
+// the sides of the view when they go farther than CLIP_GUARD_BAND times its half size
+// (the rasterizer skips the pixels out of the canvas, within the guard band).
+#define CLIP_GUARD_BAND 16.0
+
+// Most vertices of a clipped polygon: a triangle gains at most one vertex per plane.
+#define CLIP_MAX_VERTICES 8
+
+/*
+  Outcode bits of a vertex: the clip planes it is outside of. The view volume, in
+  homogeneous clip coordinates (x, y, z, w), is -w <= x, y <= w and z <= w (the near
+  plane, see Scene::projection_matrix).
+*/
+enum ClipCode
+{
+  clip_near = 1,   // in front of the near plane (or behind the camera)
+  clip_left = 2,   // left of the view
+  clip_right = 4,  // right of the view
+  clip_bottom = 8, // below the view
+  clip_top = 16,   // above the view
+  clip_guard = 32  // out of the guard band
+};
+
+// The outcode of a vertex, from its projection (x/w, y/w, z/w). The projection must put
+// z = 1, so that z/w is 1/w: the vertex is behind the near plane (w >= 1) if 0 < z/w <= 1.
+// The other planes are only tested for those vertices (the others have no meaningful
+// projection), so a triangle can be rejected if the outcodes of its vertices share a bit
+// (other than clip_guard).
+inline uint8_t clip_outcode(aline::real x, aline::real y, aline::real z)
+{
+  if (!(z > 0 && z <= 1))
+    return clip_near;
+  uint8_t code = 0;
+  if (x < -1)
+    code |= clip_left;
+  if (x > 1)
+    code |= clip_right;
+  if (y < -1)
+    code |= clip_bottom;
+  if (y > 1)
+    code |= clip_top;
+  if (fabs(x) > CLIP_GUARD_BAND || fabs(y) > CLIP_GUARD_BAND)
+    code |= clip_guard;
+  return code;
+}
+
+// Clips a convex polygon of n vertices (in homogeneous clip coordinates) against the plane
+// dot(plane, v) >= 0, with the Sutherland-Hodgman algorithm. Writes the clipped polygon
+// in out (which must hold n + 1 vertices) and returns its number of vertices.
+inline int clip_polygon(const aline::Vec4r *in, int n, const aline::Vec4r &plane, aline::Vec4r *out)
+{
+  int count = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    const aline::Vec4r &a = in[i], &b = in[(i + 1) % n];
+    aline::real da = dot(plane, a), db = dot(plane, b);
+    if (da >= 0)
+      out[count++] = a;
+    if ((da >= 0) != (db >= 0))
+    {
+      // the edge crosses the plane, at the point where the distance is 0
+      aline::real t = da / (da - db);
+      out[count++] = a + (b - a) * t;
+    }
+  }
+  return count;
+}
+
+// Clips a triangle (in homogeneous clip coordinates) against the near plane and the
+// guard band. Writes the clipped (convex) polygon in out and returns its number of
+// vertices, 0 if nothing is left.
+inline int clip_triangle(const aline::Vec4r (&triangle)[3], aline::Vec4r (&out)[CLIP_MAX_VERTICES])
+{
+  const aline::real g = CLIP_GUARD_BAND;
+  const aline::Vec4r planes[5] = {{0.0, 0.0, -1.0, 1.0}, // near: z <= w
+                                  {1.0, 0.0, 0.0, g},    // guard band: -g w <= x, y <= g w
+                                  {-1.0, 0.0, 0.0, g},
+                                  {0.0, 1.0, 0.0, g},
+                                  {0.0, -1.0, 0.0, g}};
+
+  aline::Vec4r buffer[CLIP_MAX_VERTICES];
+  aline::Vec4r *in = out, *clipped = buffer;
+  int n = 3;
+  for (int i = 0; i < 3; ++i)
+    out[i] = triangle[i];
+  for (const aline::Vec4r &plane : planes)
+  {
+    n = clip_polygon(in, n, plane, clipped);
+    std::swap(in, clipped);
+    if (n == 0)
+      return 0;
+  }
+  if (in != out)
+    for (int i = 0; i < n; ++i)
+      out[i] = in[i];
+  return n;
+}
+
+#endif
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "color.h"
+#include "matrix.h"
+
+#ifndef FRAMEBUFFER_H
+
+#define FRAMEBUFFER_H
+
+// Packs a color into a RGBA32 pixel (red in the lowest byte, alpha in the highest one),
+// which is the layout of SDL_PIXELFORMAT_ABGR8888.
+inline uint32_t pack_color(const minwin::Color &c)
+{
+  return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24);
+}
+
+// Unpacks a RGBA32 pixel into a color.
+inline minwin::Color unpack_color(uint32_t p)
+{
+  return minwin::Color{(Uint8)(p & 0xff), (Uint8)((p >> 8) & 0xff), (Uint8)((p >> 16) & 0xff), (Uint8)(p >> 24)};
+}
+
+// Scalar kernel of fill_span().
+inline void fill_span_scalar(uint32_t *p, size_t n, uint32_t color)
+{
+  for (size_t i = 0; i < n; ++i)
+    p[i] = color;
+}
+
+#ifdef ALINE_X86
+// SSE2 kernel of fill_span(): aligned stores of 4 pixels, the misaligned first and last
+// pixels being written by unaligned stores (overlapping the aligned ones).
+__attribute__((target("sse2"))) inline void fill_span_sse2(uint32_t *p, size_t n, uint32_t color)
+{
+  if (n < 4)
+  {
+    fill_span_scalar(p, n, color);
+    return;
+  }
+  __m128i v = _mm_set1_epi32((int)color);
+  uint32_t *end = p + n;
+  _mm_storeu_si128((__m128i *)p, v);
+  for (uint32_t *q = (uint32_t *)(((uintptr_t)p + 16) & ~(uintptr_t)15); q + 4 <= end; q += 4)
+    _mm_store_si128((__m128i *)q, v);
+  _mm_storeu_si128((__m128i *)(end - 4), v);
+}
+
+// AVX2 kernel of fill_span(): the same, with stores of 8 pixels.
+__attribute__((target("avx2"))) inline void fill_span_avx2(uint32_t *p, size_t n, uint32_t color)
+{
+  if (n < 8)
+  {
+    fill_span_sse2(p, n, color);
+    return;
+  }
+  __m256i v = _mm256_set1_epi32((int)color);
+  uint32_t *end = p + n;
+  _mm256_storeu_si256((__m256i *)p, v);
+  for (uint32_t *q = (uint32_t *)(((uintptr_t)p + 32) & ~(uintptr_t)31); q + 8 <= end; q += 8)
+    _mm256_store_si256((__m256i *)q, v);
+  _mm256_storeu_si256((__m256i *)(end - 8), v);
+  // (the caller's SSE code would otherwise be slowed down by the dirty upper halves)
+  _mm256_zeroupper();
+}
+#endif
+
+// Writes n pixels of the given color from p, with the given kernel level, which must be
+// supported (see aline::simd_level()). Spans shorter than 32 pixels use the SSE2 kernel,
+// faster for them than the AVX2 one.
+inline void fill_span(uint32_t *p, size_t n, uint32_t color, aline::SimdLevel level)
+{
+  switch (level)
+  {
+#ifdef ALINE_X86
+  case aline::simd_avx2:
+    if (n >= 32)
+    {
+      fill_span_avx2(p, n, color);
+      break;
+    }
+    // fall through
+  case aline::simd_sse2:
+    fill_span_sse2(p, n, color);
+    break;
+#endif
+  default:
+    fill_span_scalar(p, n, color);
+    break;
+  }
+}
+
+// Writes n pixels of the given color from p, with the best kernel supported by the
+// processor. Runs of less than 4 pixels (as on the sides of triangles) are written by
+// plain stores, without dispatch.
+inline void fill_span(uint32_t *p, size_t n, uint32_t color)
+{
+  if (n < 4)
+  {
+    for (size_t i = 0; i < n; ++i)
+      p[i] = color;
+    return;
+  }
+  fill_span(p, n, color, aline::simd_level());
+}
+
+/*
+  An owned RGBA32 color buffer. The rasterizer draws into it, then the whole buffer is
+  sent to the window at once (see minwin::Window::put_buffer).
+*/
+class FrameBuffer
+{
+  int width, height;
+  std::vector<uint32_t> pixels;
+
+public:
+  FrameBuffer(int width, int height) : width(width), height(height), pixels((size_t)width * height, 0)
+  {
+  }
+
+  inline int get_width() const
+  {
+    return width;
+  }
+
+  inline int get_height() const
+  {
+    return height;
+  }
+
+  // Returns the pixels, row by row.
+  inline const uint32_t *data() const
+  {
+    return pixels.data();
+  }
+
+  inline uint32_t *data()
+  {
+    return pixels.data();
+  }
+
+  // Fills up the whole buffer with the given pixel.
+  void clear(uint32_t color)
+  {
+    ::fill_span(pixels.data(), pixels.size(), color);
+  }
+
+  // Writes n pixels from (x, y), on the same row (no bounds checking).
+  inline void fill_span(int x, int y, int n, uint32_t color)
+  {
+    ::fill_span(pixels.data() + (size_t)y * width + x, n, color);
+  }
+
+  // Writes one pixel. Pixels outside of the buffer are discarded.
+  inline void put_pixel(int x, int y, uint32_t color)
+  {
+    if (x >= 0 && y >= 0 && x < width && y < height)
+      pixels[(size_t)y * width + x] = color;
+  }
+
+  // Reads one pixel (no bounds checking).
+  inline uint32_t get_pixel(int x, int y) const
+  {
+    return pixels[(size_t)y * width + x];
+  }
+};
+
+// Writes the buffer in a binary PPM (P6) file. The alpha channel is ignored, as on the
+// window. Returns false if the file cannot be written.
+inline bool write_ppm(const FrameBuffer &fb, const std::string &file_name)
+{
+  std::ofstream f(file_name, std::ios::binary);
+  if (!f)
+    return false;
+
+  f << "P6\n" << fb.get_width() << " " << fb.get_height() << "\n255\n";
+  std::vector<char> row((size_t)fb.get_width() * 3);
+  for (int y = 0; y < fb.get_height(); ++y)
+  {
+    for (int x = 0; x < fb.get_width(); ++x)
+    {
+      uint32_t p = fb.get_pixel(x, y);
+      row[x * 3] = (char)(p & 0xff);
+      row[x * 3 + 1] = (char)((p >> 8) & 0xff);
+      row[x * 3 + 2] = (char)((p >> 16) & 0xff);
+    }
+    f.write(row.data(), row.size());
+  }
+  return (bool)f;
+}
+
+// Writes the buffer in a RGB PNG file (alpha ignored), without compression so that no
+// external library is needed. Returns false if the file cannot be written.
+inline bool write_png(const FrameBuffer &fb, const std::string &file_name)
+{
+  struct Png
+  {
+    static uint32_t crc(const std::vector<unsigned char> &bytes)
+    {
+      uint32_t c = 0xffffffffu;
+      for (unsigned char b : bytes)
+      {
+        c ^= b;
+        for (int k = 0; k < 8; ++k)
+          c = (c >> 1) ^ (0xedb88320u & (0 - (c & 1)));
+      }
+      return c ^ 0xffffffffu;
+    }
+
+    static void put32(std::vector<unsigned char> &out, uint32_t v)
+    {
+      out.push_back(v >> 24);
+      out.push_back((v >> 16) & 0xff);
+      out.push_back((v >> 8) & 0xff);
+      out.push_back(v & 0xff);
+    }
+
+    static void chunk(std::ofstream &f, const char *type, const std::vector<unsigned char> &data)
+    {
+      std::vector<unsigned char> body(type, type + 4);
+      body.insert(body.end(), data.begin(), data.end());
+      std::vector<unsigned char> head, tail;
+      put32(head, data.size());
+      put32(tail, crc(body));
+      f.write((const char *)head.data(), 4);
+      f.write((const char *)body.data(), body.size());
+      f.write((const char *)tail.data(), 4);
+    }
+  };
+
+  std::ofstream f(file_name, std::ios::binary);
+  if (!f)
+    return false;
+
+  const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+  f.write((const char *)signature, 8);
+
+  std::vector<unsigned char> ihdr;
+  Png::put32(ihdr, fb.get_width());
+  Png::put32(ihdr, fb.get_height());
+  ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8 bits, RGB, deflate, no filter, no interlace
+  Png::chunk(f, "IHDR", ihdr);
+
+  // raw scanlines, each one starting with filter type 0
+  std::vector<unsigned char> raw;
+  raw.reserve((size_t)fb.get_height() * (1 + fb.get_width() * 3));
+  for (int y = 0; y < fb.get_height(); ++y)
+  {
+    raw.push_back(0);
+    for (int x = 0; x < fb.get_width(); ++x)
+    {
+      uint32_t p = fb.get_pixel(x, y);
+      raw.push_back(p & 0xff);
+      raw.push_back((p >> 8) & 0xff);
+      raw.push_back((p >> 16) & 0xff);
+    }
+  }
+
+  // zlib stream made of stored (uncompressed) deflate blocks
+  std::vector<unsigned char> idat = {0x78, 0x01};
+  size_t pos = 0;
+  do
+  {
+    size_t len = std::min<size_t>(raw.size() - pos, 65535);
+    idat.push_back(pos + len == raw.size() ? 1 : 0);
+    idat.push_back(len & 0xff);
+    idat.push_back(len >> 8);
+    idat.push_back(~len & 0xff);
+    idat.push_back((~len >> 8) & 0xff);
+    idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + len);
+    pos += len;
+  } while (pos < raw.size());
+
+  uint32_t a = 1, b = 0;
+  for (unsigned char c : raw)
+  {
+    a = (a + c) % 65521;
+    b = (b + a) % 65521;
+  }
+  Png::put32(idat, (b << 16) | a);
+  Png::chunk(f, "IDAT", idat);
+  Png::chunk(f, "IEND", std::vector<unsigned char>());
+
+  return (bool)f;
+}
+
+#endif
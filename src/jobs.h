@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef JOBS_H
+
+#define JOBS_H
+
+// A group of jobs, whose end can be waited for (see JobSystem::wait).
+class JobGroup
+{
+  std::atomic<size_t> pending; // jobs added and not done yet
+  friend class JobSystem;
+
+public:
+  JobGroup() : pending(0)
+  {
+  }
+
+  bool done() const
+  {
+    return pending == 0;
+  }
+};
+
+/*
+  A fixed pool of worker threads running jobs, with work stealing. Each thread has its
+  own queue of jobs: it adds jobs at the back of its queue and takes them from the back
+  (the last added, whose data is still in its cache), while the idle threads steal from
+  the front of the other queues (the oldest, usually the largest part of the work left).
+  The threads outside of the pool share one more queue, and work on jobs while they wait
+  for a group.
+
+  Jobs are a function pointer with its context and a range of indices: adding them
+  allocates nothing once the queues have grown. They must not throw.
+*/
+class JobSystem
+{
+  struct Job
+  {
+    void (*run)(const void *context, size_t begin, size_t end);
+    const void *context;
+    size_t begin, end;
+    JobGroup *group;
+  };
+
+  struct Queue
+  {
+    std::mutex mutex;
+    std::vector<Job> jobs;
+    size_t head; // jobs before it were stolen
+
+    Queue() : head(0)
+    {
+    }
+  };
+
+  // The queue of a thread of the pool.
+  struct Worker
+  {
+    const JobSystem *system;
+    size_t queue;
+  };
+
+  std::vector<Queue> queues; // queue 0 is the one of the threads outside of the pool
+  std::vector<std::thread> threads;
+  std::atomic<size_t> queued; // jobs in the queues
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  bool stopping;
+
+public:
+  // A pool of thread_count threads, the calling one included (so thread_count - 1 are
+  // started).
+  explicit JobSystem(unsigned thread_count) : queued(0), stopping(false)
+  {
+    start(std::max(thread_count, 1u));
+  }
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  ~JobSystem()
+  {
+    stop();
+  }
+
+  // The number of threads working on the jobs, the waiting one included.
+  unsigned get_thread_count() const
+  {
+    return threads.size() + 1;
+  }
+
+  // Stops the threads and starts thread_count - 1 new ones. No job must be left.
+  void set_thread_count(unsigned thread_count)
+  {
+    thread_count = std::max(thread_count, 1u);
+    if (thread_count == get_thread_count())
+      return;
+    stop();
+    start(thread_count);
+  }
+
+  // Adds a job to the group, calling f(begin, end). f is not copied: it must live until
+  // the group is done.
+  template <class F>
+  void run(JobGroup &group, const F &f, size_t begin, size_t end)
+  {
+    push(Job{&invoke<F>, &f, begin, end, &group});
+    wake_threads();
+  }
+
+  // Adds a job to the group, calling f().
+  template <class F>
+  void run(JobGroup &group, const F &f)
+  {
+    push(Job{&invoke_task<F>, &f, 0, 0, &group});
+    wake_threads();
+  }
+
+  // Works on the jobs (of any group) until those of the group are done.
+  void wait(JobGroup &group)
+  {
+    size_t queue = own_queue();
+    while (group.pending > 0)
+      if (!run_one(queue))
+        std::this_thread::yield();
+  }
+
+  // Calls f(b, e) on consecutive ranges [b, e) covering [begin, end), in parallel, and
+  // returns once they are all done. The ranges are not smaller than grain (unless there
+  // is only one), and there are a few per thread, so that the threads done first steal from
+  // the others. It can be called from a job.
+  template <class F>
+  void parallel_for(size_t begin, size_t end, size_t grain, const F &f)
+  {
+    if (begin >= end)
+      return;
+    grain = std::max(grain, (size_t)1);
+    size_t count = end - begin;
+    size_t chunks = std::min(count / grain, (size_t)get_thread_count() * 4);
+    if (chunks <= 1 || threads.empty())
+    {
+      f(begin, end);
+      return;
+    }
+
+    JobGroup group;
+    for (size_t c = 0; c < chunks; ++c)
+      push(Job{&invoke<F>, &f, begin + count * c / chunks, begin + count * (c + 1) / chunks, &group});
+    wake_threads();
+    wait(group);
+  }
+
+private:
+  template <class F>
+  static void invoke(const void *f, size_t begin, size_t end)
+  {
+    (*static_cast<const F *>(f))(begin, end);
+  }
+
+  template <class F>
+  static void invoke_task(const void *f, size_t, size_t)
+  {
+    (*static_cast<const F *>(f))();
+  }
+
+  // The queue of the calling thread in the pool it belongs to.
+  static Worker &current_worker()
+  {
+    static thread_local Worker worker{nullptr, 0};
+    return worker;
+  }
+
+  size_t own_queue() const
+  {
+    const Worker &w = current_worker();
+    return w.system == this ? w.queue : 0;
+  }
+
+  void start(unsigned thread_count)
+  {
+    std::vector<Queue>(thread_count).swap(queues);
+    stopping = false;
+    threads.reserve(thread_count - 1);
+    for (unsigned i = 1; i < thread_count; ++i)
+      threads.push_back(std::thread(&JobSystem::work, this, (size_t)i));
+  }
+
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads)
+      t.join();
+    threads.clear();
+  }
+
+  // The loop of the threads of the pool: sleeps while there is no job.
+  void work(size_t queue)
+  {
+    current_worker() = Worker{this, queue};
+    while (true)
+    {
+      if (run_one(queue))
+        continue;
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      wake.wait(lock, [this]()
+                { return queued > 0 || stopping; });
+      if (stopping)
+        return;
+    }
+  }
+
+  void push(const Job &job)
+  {
+    ++job.group->pending;
+    ++queued;
+    Queue &q = queues[own_queue()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.jobs.push_back(job);
+  }
+
+  void wake_threads()
+  {
+    if (threads.empty())
+      return;
+    // (taking the lock orders the new jobs before the check of sleeping threads)
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_all();
+  }
+
+  // Runs one job, taken from the back of the given queue or else stolen from the front
+  // of another one. Returns false if there was none.
+  bool run_one(size_t queue)
+  {
+    Job job;
+    bool found = take(queues[queue], true, job);
+    for (size_t i = 1; i < queues.size() && !found; ++i)
+      found = take(queues[(queue + i) % queues.size()], false, job);
+    if (!found)
+      return false;
+    job.run(job.context, job.begin, job.end);
+    --job.group->pending;
+    return true;
+  }
+
+  bool take(Queue &q, bool back, Job &job)
+  {
+    if (queued == 0)
+      return false;
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.head == q.jobs.size())
+      return false;
+    if (back)
+    {
+      job = q.jobs.back();
+      q.jobs.pop_back();
+    }
+    else
+      job = q.jobs[q.head++];
+    if (q.head == q.jobs.size())
+    {
+      q.jobs.clear();
+      q.head = 0;
+    }
+    --queued;
+    return true;
+  }
+};
+
+// A first in, first out queue holding at most a fixed number of items, between two
+// threads (or stages of a pipeline): push waits while it is full and pop while it is
+// empty. Its storage is allocated once.
+template <class T>
+class BoundedQueue
+{
+  std::vector<T> items; // ring buffer
+  size_t head, count;   // the first item and the number of items
+  std::mutex mutex;
+  std::condition_variable not_empty, not_full;
+
+public:
+  explicit BoundedQueue(size_t capacity) : items(std::max(capacity, (size_t)1)), head(0), count(0)
+  {
+  }
+
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  size_t capacity() const
+  {
+    return items.size();
+  }
+
+  // Adds an item at the back, once there is room.
+  void push(const T &item)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      not_full.wait(lock, [this]()
+                    { return count < items.size(); });
+      items[(head + count) % items.size()] = item;
+      ++count;
+    }
+    not_empty.notify_one();
+  }
+
+  // Removes the item at the front, once there is one.
+  T pop()
+  {
+    T item;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      not_empty.wait(lock, [this]()
+                     { return count > 0; });
+      item = items[head];
+      head = (head + 1) % items.size();
+      --count;
+    }
+    not_full.notify_one();
+    return item;
+  }
+};
+
+#endif
@@ -1,5 +1,12 @@
+#include <algorithm>
+#include <cstdint>
 #include "vector.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ALINE_X86
+#endif
+
 #ifndef MATRIX_H
 
 #define MATRIX_H
@@ -67,7 +74,7 @@ namespace aline
     }
 
     // Subscripting (the as at(), but does not throw an exception).
-    Vector<T, N> operator[](size_t i) const
+    const Vector<T, N> &operator[](size_t i) const
     {
       return vectors[i];
     }
@@ -159,6 +166,112 @@ namespace aline
     return identity;
   }
 
+  // The inverse of a rigid transform (a rotation followed by a translation, no scaling):
+  // the transpose of the rotation and the opposite of the rotated translation,
+  //   [ R t ]^-1   [ R^T -R^T t ]
+  //   [ 0 1 ]    = [ 0    1     ]
+  // The matrix must actually be rigid (it is not checked).
+  template <class T>
+  Matrix<double, 4, 4> inverse_rigid(const Matrix<T, 4, 4> &m)
+  {
+    Matrix<double, 4, 4> result;
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+        result[i][j] = m[j][i];
+      result[i][3] = -(m[0][i] * (double)m[0][3] + m[1][i] * (double)m[1][3] + m[2][i] * (double)m[2][3]);
+    }
+    result[3][3] = 1;
+    return result;
+  }
+
+  // The inverse of an affine transform (last row 0 0 0 1), using the cofactors of its
+  // 3x3 linear part A,
+  //   [ A t ]^-1   [ A^-1 -A^-1 t ]
+  //   [ 0 1 ]    = [ 0     1      ]
+  // If A is not invertible, returns a NAN (not a number) matrix.
+  template <class T>
+  Matrix<double, 4, 4> inverse_affine(const Matrix<T, 4, 4> &m)
+  {
+    double a[3][3];
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        a[i][j] = m[i][j];
+
+    // cofactors of the first row give the determinant
+    double c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+    double c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+    double c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+    double det = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+    double inv_det = det == 0 ? std::nan("") : 1 / det;
+
+    // A^-1 is the transposed cofactor matrix divided by the determinant
+    Matrix<double, 4, 4> result;
+    result[0][0] = c00 * inv_det;
+    result[1][0] = c01 * inv_det;
+    result[2][0] = c02 * inv_det;
+    result[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * inv_det;
+    result[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * inv_det;
+    result[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * inv_det;
+    result[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * inv_det;
+    result[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * inv_det;
+    result[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * inv_det;
+
+    for (int i = 0; i < 3; ++i)
+      result[i][3] = -(result[i][0] * m[0][3] + result[i][1] * m[1][3] + result[i][2] * m[2][3]);
+    result[3][3] = 1;
+    return result;
+  }
+
+  // The inverse of a 4x4 matrix using cofactors (computed from the 2x2 sub-determinants
+  // of the two upper and the two lower rows). Unlike inverse(), there is no pivoting and
+  // no branch: every element is a fixed expression, which suits SIMD. If the matrix is not
+  // invertible, returns a NAN (not a number) matrix.
+  template <class T>
+  Matrix<double, 4, 4> inverse_cofactors(const Matrix<T, 4, 4> &m)
+  {
+    double a[4][4];
+    for (int i = 0; i < 4; ++i)
+      for (int j = 0; j < 4; ++j)
+        a[i][j] = m[i][j];
+
+    // 2x2 sub-determinants of the rows 0 and 1 (s) and of the rows 2 and 3 (c)
+    double s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+    double s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+    double s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+    double s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+    double s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+    double s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+    double c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+    double c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+    double c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+    double c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+    double c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+    double c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+
+    double det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    double inv_det = det == 0 ? std::nan("") : 1 / det;
+
+    Matrix<double, 4, 4> result;
+    result[0][0] = (a[1][1] * c5 - a[1][2] * c4 + a[1][3] * c3) * inv_det;
+    result[0][1] = (-a[0][1] * c5 + a[0][2] * c4 - a[0][3] * c3) * inv_det;
+    result[0][2] = (a[3][1] * s5 - a[3][2] * s4 + a[3][3] * s3) * inv_det;
+    result[0][3] = (-a[2][1] * s5 + a[2][2] * s4 - a[2][3] * s3) * inv_det;
+    result[1][0] = (-a[1][0] * c5 + a[1][2] * c2 - a[1][3] * c1) * inv_det;
+    result[1][1] = (a[0][0] * c5 - a[0][2] * c2 + a[0][3] * c1) * inv_det;
+    result[1][2] = (-a[3][0] * s5 + a[3][2] * s2 - a[3][3] * s1) * inv_det;
+    result[1][3] = (a[2][0] * s5 - a[2][2] * s2 + a[2][3] * s1) * inv_det;
+    result[2][0] = (a[1][0] * c4 - a[1][1] * c2 + a[1][3] * c0) * inv_det;
+    result[2][1] = (-a[0][0] * c4 + a[0][1] * c2 - a[0][3] * c0) * inv_det;
+    result[2][2] = (a[3][0] * s4 - a[3][1] * s2 + a[3][3] * s0) * inv_det;
+    result[2][3] = (-a[2][0] * s4 + a[2][1] * s2 - a[2][3] * s0) * inv_det;
+    result[3][0] = (-a[1][0] * c3 + a[1][1] * c1 - a[1][2] * c0) * inv_det;
+    result[3][1] = (a[0][0] * c3 - a[0][1] * c1 + a[0][2] * c0) * inv_det;
+    result[3][2] = (-a[3][0] * s3 + a[3][1] * s1 - a[3][2] * s0) * inv_det;
+    result[3][3] = (a[2][0] * s3 - a[2][1] * s1 + a[2][2] * s0) * inv_det;
+    return result;
+  }
+
   // Tests if a matrix contains NAN (not a number) values.
   template <class T, int M, int N>
   bool isnan(const Matrix<T, M, N> &m)
@@ -260,43 +373,47 @@ namespace aline
     return s * m;
   }
 
-  // The product of a matrix and a vector.
+  // The product of a matrix and a vector. Each element is accumulated directly (fused
+  // multiply and sum, no intermediate vector).
   template <class T, int M, int N>
   Vector<T, M> operator*(const Matrix<T, M, N> &m, const Vector<T, N> &v)
   {
-    Vector<T, M> result = Vector<T, M>();
-
+    Vector<T, M> result;
     for (int i = 0; i < M; ++i)
     {
-      Vector<T, N> prod = v * m[i];
+      const Vector<T, N> &row = m[i];
+      T sum = 0;
       for (int j = 0; j < N; ++j)
-      {
-        result[i] += prod[j];
-      }
+        sum += v[j] * row[j];
+      result[i] = sum;
     }
     return result;
   }
 
-  // The product of two matrices.
+  // The product of a matrix and a vector expression (evaluated once).
+  template <class T, int M, int N, class E>
+  Vector<T, M> operator*(const Matrix<T, M, N> &m, const VectorExpr<E, T, N> &v)
+  {
+    return m * Vector<T, N>(v);
+  }
+
+  // The product of two matrices. Evaluated at once (a lazy product would compute each
+  // element again at each use), each element being accumulated directly without
+  // building columns or intermediate vectors.
   template <class T, int M, int N, int O>
   Matrix<T, M, O> operator*(const Matrix<T, M, N> &m1, const Matrix<T, N, O> &m2)
   {
-    Matrix<T, M, O> result = Matrix<T, M, O>();
+    Matrix<T, M, O> result;
     for (int i = 0; i < M; ++i)
     {
-      Vector<T, N> v1 = m1[i];
+      const Vector<T, N> &row = m1[i];
+      Vector<T, O> &out = result[i];
       for (int j = 0; j < O; ++j)
       {
-        Vector<T, N> v2 = Vector<T, N>();
+        T sum = 0;
         for (int k = 0; k < N; ++k)
-        {
-          v2[k] = m2[k][j];
-        }
-        Vector<T, N> prod = v1 * v2;
-        for (int p = 0; p < N; ++p)
-        {
-          result[i][j] += prod[p];
-        }
+          sum += row[k] * m2[k][j];
+        out[j] = sum;
       }
     }
 
@@ -358,6 +475,264 @@ namespace aline
 
   using Mat33r = Matrix<real,3ul,3ul>;
   using Mat44r = Matrix<real,4ul,4ul>;
+
+  // Instruction sets of the batch kernels.
+  enum SimdLevel
+  {
+    simd_scalar,
+    simd_sse2,
+    simd_avx2
+  };
+
+  // The best instruction set supported by the processor (detected once, at runtime).
+  inline SimdLevel simd_level()
+  {
+#ifdef ALINE_X86
+    static const SimdLevel level = []()
+    {
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+        return simd_avx2;
+      if (__builtin_cpu_supports("sse2"))
+        return simd_sse2;
+      return simd_scalar;
+    }();
+    return level;
+#else
+    return simd_scalar;
+#endif
+  }
+
+  // Scalar kernel of transform_points(), for the points of indices begin to end - 1. The
+  // operations are done in the same order as in operator*( Matrix, Vector ), so that the
+  // results are the same.
+  inline void transform_points_scalar(const real (&c)[4][4], const real *x, const real *y, const real *z,
+                                      size_t begin, size_t end, real *out_x, real *out_y, real *out_z)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      real rx = c[0][0] * x[i] + c[0][1] * y[i] + c[0][2] * z[i] + c[0][3];
+      real ry = c[1][0] * x[i] + c[1][1] * y[i] + c[1][2] * z[i] + c[1][3];
+      real rz = c[2][0] * x[i] + c[2][1] * y[i] + c[2][2] * z[i] + c[2][3];
+      real rw = c[3][0] * x[i] + c[3][1] * y[i] + c[3][2] * z[i] + c[3][3];
+      if (rw == 0)
+      {
+        out_x[i] = out_y[i] = out_z[i] = 0;
+      }
+      else
+      {
+        out_x[i] = rx / rw;
+        out_y[i] = ry / rw;
+        out_z[i] = rz / rw;
+      }
+    }
+  }
+
+#ifdef ALINE_X86
+  // SSE2 kernel of transform_points(): two points per iteration.
+  __attribute__((target("sse2"))) inline void transform_points_sse2(const real (&c)[4][4], const real *x, const real *y, const real *z,
+                                                                    size_t n, real *out_x, real *out_y, real *out_z)
+  {
+    __m128d m[4][4];
+    for (int i = 0; i < 4; ++i)
+      for (int j = 0; j < 4; ++j)
+        m[i][j] = _mm_set1_pd(c[i][j]);
+    const __m128d zero = _mm_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+      __m128d vx = _mm_loadu_pd(x + i), vy = _mm_loadu_pd(y + i), vz = _mm_loadu_pd(z + i);
+      __m128d r[4];
+      for (int k = 0; k < 4; ++k)
+        r[k] = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(m[k][0], vx), _mm_mul_pd(m[k][1], vy)), _mm_mul_pd(m[k][2], vz)), m[k][3]);
+
+      // points with w == 0 are sent to the origin
+      __m128d w_zero = _mm_cmpeq_pd(r[3], zero);
+      _mm_storeu_pd(out_x + i, _mm_andnot_pd(w_zero, _mm_div_pd(r[0], r[3])));
+      _mm_storeu_pd(out_y + i, _mm_andnot_pd(w_zero, _mm_div_pd(r[1], r[3])));
+      _mm_storeu_pd(out_z + i, _mm_andnot_pd(w_zero, _mm_div_pd(r[2], r[3])));
+    }
+    transform_points_scalar(c, x, y, z, i, n, out_x, out_y, out_z);
+  }
+
+  // AVX2 kernel of transform_points(): four points per iteration.
+  __attribute__((target("avx2"))) inline void transform_points_avx2(const real (&c)[4][4], const real *x, const real *y, const real *z,
+                                                                    size_t n, real *out_x, real *out_y, real *out_z)
+  {
+    __m256d m[4][4];
+    for (int i = 0; i < 4; ++i)
+      for (int j = 0; j < 4; ++j)
+        m[i][j] = _mm256_set1_pd(c[i][j]);
+    const __m256d zero = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      __m256d vx = _mm256_loadu_pd(x + i), vy = _mm256_loadu_pd(y + i), vz = _mm256_loadu_pd(z + i);
+      __m256d r[4];
+      for (int k = 0; k < 4; ++k)
+        r[k] = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m[k][0], vx), _mm256_mul_pd(m[k][1], vy)), _mm256_mul_pd(m[k][2], vz)), m[k][3]);
+
+      // points with w == 0 are sent to the origin
+      __m256d w_zero = _mm256_cmp_pd(r[3], zero, _CMP_EQ_OQ);
+      _mm256_storeu_pd(out_x + i, _mm256_andnot_pd(w_zero, _mm256_div_pd(r[0], r[3])));
+      _mm256_storeu_pd(out_y + i, _mm256_andnot_pd(w_zero, _mm256_div_pd(r[1], r[3])));
+      _mm256_storeu_pd(out_z + i, _mm256_andnot_pd(w_zero, _mm256_div_pd(r[2], r[3])));
+    }
+    transform_points_scalar(c, x, y, z, i, n, out_x, out_y, out_z);
+    // (the caller's SSE code would otherwise be slowed down by the dirty upper halves)
+    _mm256_zeroupper();
+  }
+#endif
+
+  // Transforms n points by the matrix m, including the perspective divide. The points are
+  // given as separate arrays of coordinates (x[i], y[i], z[i]) with an implicit w = 1, and
+  // (x/w, y/w, z/w) is written in out_x[i], out_y[i] and out_z[i]. Points with w == 0 are
+  // sent to the origin. By default, uses the best kernel supported by the processor;
+  // level must be supported (see simd_level()).
+  inline void transform_points(const Mat44r &m, const real *x, const real *y, const real *z, size_t n,
+                               real *out_x, real *out_y, real *out_z, SimdLevel level = simd_level())
+  {
+    real c[4][4];
+    for (int i = 0; i < 4; ++i)
+      for (int j = 0; j < 4; ++j)
+        c[i][j] = m.at(i, j);
+
+    switch (level)
+    {
+#ifdef ALINE_X86
+    case simd_avx2:
+      transform_points_avx2(c, x, y, z, n, out_x, out_y, out_z);
+      break;
+    case simd_sse2:
+      transform_points_sse2(c, x, y, z, n, out_x, out_y, out_z);
+      break;
+#endif
+    default:
+      transform_points_scalar(c, x, y, z, 0, n, out_x, out_y, out_z);
+      break;
+    }
+  }
+
+  // Scalar kernel of cull_bounds(), for the bounds of indices begin to end - 1.
+  inline void cull_bounds_scalar(const real (&planes)[6][4], const real *cx, const real *cy, const real *cz,
+                                 const real *ex, const real *ey, const real *ez, const real *r,
+                                 size_t begin, size_t end, uint8_t *visible)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      bool inside = true;
+      for (int p = 0; p < 6; ++p)
+      {
+        const real *q = planes[p];
+        real dist = q[0] * cx[i] + q[1] * cy[i] + q[2] * cz[i] + q[3];
+        real box = fabs(q[0]) * ex[i] + fabs(q[1]) * ey[i] + fabs(q[2]) * ez[i];
+        inside = inside && dist + std::min(r[i], box) >= 0;
+      }
+      visible[i] = inside;
+    }
+  }
+
+#ifdef ALINE_X86
+  // SSE2 kernel of cull_bounds(): two bounds per iteration.
+  __attribute__((target("sse2"))) inline void cull_bounds_sse2(const real (&planes)[6][4], const real *cx, const real *cy, const real *cz,
+                                                               const real *ex, const real *ey, const real *ez, const real *r,
+                                                               size_t n, uint8_t *visible)
+  {
+    const __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+      __m128d vcx = _mm_loadu_pd(cx + i), vcy = _mm_loadu_pd(cy + i), vcz = _mm_loadu_pd(cz + i);
+      __m128d vex = _mm_loadu_pd(ex + i), vey = _mm_loadu_pd(ey + i), vez = _mm_loadu_pd(ez + i);
+      __m128d vr = _mm_loadu_pd(r + i);
+      __m128d inside = _mm_cmpeq_pd(zero, zero);
+      for (int p = 0; p < 6; ++p)
+      {
+        const real *q = planes[p];
+        __m128d dist = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(q[0]), vcx), _mm_mul_pd(_mm_set1_pd(q[1]), vcy)),
+                                             _mm_mul_pd(_mm_set1_pd(q[2]), vcz)),
+                                  _mm_set1_pd(q[3]));
+        __m128d box = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(fabs(q[0])), vex), _mm_mul_pd(_mm_set1_pd(fabs(q[1])), vey)),
+                                 _mm_mul_pd(_mm_set1_pd(fabs(q[2])), vez));
+        inside = _mm_and_pd(inside, _mm_cmpge_pd(_mm_add_pd(dist, _mm_min_pd(vr, box)), zero));
+      }
+      int mask = _mm_movemask_pd(inside);
+      visible[i] = mask & 1;
+      visible[i + 1] = (mask >> 1) & 1;
+    }
+    cull_bounds_scalar(planes, cx, cy, cz, ex, ey, ez, r, i, n, visible);
+  }
+
+  // AVX2 kernel of cull_bounds(): four bounds per iteration.
+  __attribute__((target("avx2"))) inline void cull_bounds_avx2(const real (&planes)[6][4], const real *cx, const real *cy, const real *cz,
+                                                               const real *ex, const real *ey, const real *ez, const real *r,
+                                                               size_t n, uint8_t *visible)
+  {
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      __m256d vcx = _mm256_loadu_pd(cx + i), vcy = _mm256_loadu_pd(cy + i), vcz = _mm256_loadu_pd(cz + i);
+      __m256d vex = _mm256_loadu_pd(ex + i), vey = _mm256_loadu_pd(ey + i), vez = _mm256_loadu_pd(ez + i);
+      __m256d vr = _mm256_loadu_pd(r + i);
+      __m256d inside = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+      for (int p = 0; p < 6; ++p)
+      {
+        const real *q = planes[p];
+        __m256d dist = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(q[0]), vcx), _mm256_mul_pd(_mm256_set1_pd(q[1]), vcy)),
+                                                   _mm256_mul_pd(_mm256_set1_pd(q[2]), vcz)),
+                                     _mm256_set1_pd(q[3]));
+        __m256d box = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(fabs(q[0])), vex), _mm256_mul_pd(_mm256_set1_pd(fabs(q[1])), vey)),
+                                    _mm256_mul_pd(_mm256_set1_pd(fabs(q[2])), vez));
+        inside = _mm256_and_pd(inside, _mm256_cmp_pd(_mm256_add_pd(dist, _mm256_min_pd(vr, box)), zero, _CMP_GE_OQ));
+      }
+      int mask = _mm256_movemask_pd(inside);
+      for (int k = 0; k < 4; ++k)
+        visible[i + k] = (mask >> k) & 1;
+    }
+    cull_bounds_scalar(planes, cx, cy, cz, ex, ey, ez, r, i, n, visible);
+    // (the caller's SSE code would otherwise be slowed down by the dirty upper halves)
+    _mm256_zeroupper();
+  }
+#endif
+
+  // Tests n bounding volumes against 6 planes (such as the planes of a frustum). Volume i
+  // is the box of center (cx[i], cy[i], cz[i]) and half extents (ex[i], ey[i], ez[i])
+  // along the axes, together with the sphere of radius r[i] around the same center. A
+  // plane (a, b, c, d) keeps the points where ax + by + cz + d >= 0. visible[i] is set to
+  // 0 if the box or the sphere is entirely outside one of the planes, to 1 otherwise (the
+  // test is conservative: a visible volume can still be outside of the frustum, near its
+  // edges). level must be supported (see simd_level()).
+  inline void cull_bounds(const real (&planes)[6][4], const real *cx, const real *cy, const real *cz,
+                          const real *ex, const real *ey, const real *ez, const real *r, size_t n,
+                          uint8_t *visible, SimdLevel level = simd_level())
+  {
+    // with unit normals, the distance to a plane can be compared to the radius
+    real unit[6][4];
+    for (int p = 0; p < 6; ++p)
+    {
+      real length = sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+      for (int k = 0; k < 4; ++k)
+        unit[p][k] = length == 0 ? planes[p][k] : planes[p][k] / length;
+    }
+
+    switch (level)
+    {
+#ifdef ALINE_X86
+    case simd_avx2:
+      cull_bounds_avx2(unit, cx, cy, cz, ex, ey, ez, r, n, visible);
+      break;
+    case simd_sse2:
+      cull_bounds_sse2(unit, cx, cy, cz, ex, ey, ez, r, n, visible);
+      break;
+#endif
+    default:
+      cull_bounds_scalar(unit, cx, cy, cz, ex, ey, ez, r, 0, n, visible);
+      break;
+    }
+  }
 }
 
 #endif
\ No newline at end of file
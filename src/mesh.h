@@ -0,0 +1,148 @@
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "color.h"
+#include "vector.h"
+
+#ifndef MESH_H
+
+#define MESH_H
+
+// Alignment (in bytes) of the coordinate arrays of a mesh, enough for AVX loads.
+#define MESH_ALIGNMENT 32
+
+// A std::allocator replacement returning memory aligned on A bytes.
+template <class T, size_t A>
+class AlignedAllocator
+{
+public:
+  using value_type = T;
+
+  template <class U>
+  struct rebind
+  {
+    using other = AlignedAllocator<U, A>;
+  };
+
+  AlignedAllocator() {}
+
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, A> &) {}
+
+  T *allocate(size_t n)
+  {
+    void *p = nullptr;
+    if (posix_memalign(&p, A, n * sizeof(T) == 0 ? A : n * sizeof(T)) != 0)
+      throw std::bad_alloc();
+    return static_cast<T *>(p);
+  }
+
+  void deallocate(T *p, size_t)
+  {
+    free(p);
+  }
+};
+
+template <class T, class U, size_t A>
+bool operator==(const AlignedAllocator<T, A> &, const AlignedAllocator<U, A> &)
+{
+  return true;
+}
+
+template <class T, class U, size_t A>
+bool operator!=(const AlignedAllocator<T, A> &, const AlignedAllocator<U, A> &)
+{
+  return false;
+}
+
+// An array of coordinates, aligned on MESH_ALIGNMENT bytes.
+using CoordArray = std::vector<aline::real, AlignedAllocator<aline::real, MESH_ALIGNMENT>>;
+
+/*
+  A triangle mesh stored as a structure of arrays: the x, y and z coordinates of the
+  vertices are in three separate contiguous (and aligned) arrays, the faces are a flat
+  index buffer (three indices per face) and their colors are in their own array.
+*/
+class Mesh
+{
+  CoordArray x, y, z;
+  std::vector<uint32_t> indices;
+  std::vector<minwin::Color> colors;
+
+public:
+  Mesh()
+  {
+  }
+
+  // Reserves space for the given number of vertices and faces.
+  void reserve(size_t vertex_count, size_t face_count)
+  {
+    x.reserve(vertex_count);
+    y.reserve(vertex_count);
+    z.reserve(vertex_count);
+    indices.reserve(face_count * 3);
+    colors.reserve(face_count);
+  }
+
+  void add_vertex(aline::real vx, aline::real vy, aline::real vz)
+  {
+    x.push_back(vx);
+    y.push_back(vy);
+    z.push_back(vz);
+  }
+
+  void add_face(uint32_t v0, uint32_t v1, uint32_t v2, const minwin::Color &color)
+  {
+    indices.push_back(v0);
+    indices.push_back(v1);
+    indices.push_back(v2);
+    colors.push_back(color);
+  }
+
+  inline size_t vertex_count() const
+  {
+    return x.size();
+  }
+
+  inline size_t face_count() const
+  {
+    return colors.size();
+  }
+
+  // The coordinates of the vertices.
+  inline const CoordArray &get_x() const
+  {
+    return x;
+  }
+
+  inline const CoordArray &get_y() const
+  {
+    return y;
+  }
+
+  inline const CoordArray &get_z() const
+  {
+    return z;
+  }
+
+  // The vertex i as a vector.
+  inline aline::Vec3r get_vertex(size_t i) const
+  {
+    return aline::Vec3r({x[i], y[i], z[i]});
+  }
+
+  // The index buffer: face f is made of the vertices indices[3f], indices[3f+1] and indices[3f+2].
+  inline const std::vector<uint32_t> &get_indices() const
+  {
+    return indices;
+  }
+
+  // The color of each face.
+  inline const std::vector<minwin::Color> &get_colors() const
+  {
+    return colors;
+  }
+};
+
+#endif
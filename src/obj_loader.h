@@ -0,0 +1,267 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mesh.h"
+
+#ifndef OBJ_LOADER_H
+
+#define OBJ_LOADER_H
+
+// A file mapped in memory, read only (an empty file has no bytes).
+class MappedFile
+{
+  const char *bytes;
+  size_t length;
+  bool readable;
+
+public:
+  explicit MappedFile(const std::string &file_name) : bytes(nullptr), length(0), readable(false)
+  {
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+      readable = true;
+      if (st.st_size > 0)
+      {
+        void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED)
+        {
+          bytes = static_cast<const char *>(m);
+          length = st.st_size;
+          // (the file is read once, from the start)
+          madvise(m, length, MADV_SEQUENTIAL);
+        }
+        else
+          readable = false;
+      }
+    }
+    close(fd);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile()
+  {
+    if (bytes != nullptr)
+      munmap(const_cast<char *>(bytes), length);
+  }
+
+  bool is_open() const
+  {
+    return readable;
+  }
+
+  const char *data() const
+  {
+    return bytes;
+  }
+
+  size_t size() const
+  {
+    return length;
+  }
+};
+
+inline bool is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+// Parses a decimal number ([+-]digits[.digits][(e|E)[+-]digits], digits being optional on
+// one side of the point) from p, not past end, and moves p after it. Returns false, with
+// p unchanged, if there is none. Unlike strtod, it ignores the locale. The number is
+// exact when it has at most 15 significant digits and a small exponent (as in the
+// usual OBJ files), otherwise it may be off by a few units in the last place.
+inline bool parse_real(const char *&p, const char *end, aline::real &value)
+{
+  // exact powers of ten in a double
+  static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+
+  // the first 19 significant digits, times 10^exponent
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+  for (; s < end && is_digit(*s); ++s, any = true)
+    if (digits < 19)
+    {
+      mantissa = mantissa * 10 + (*s - '0');
+      digits += mantissa != 0;
+    }
+    else
+      ++exponent;
+  if (s < end && *s == '.')
+    for (++s; s < end && is_digit(*s); ++s, any = true)
+      if (digits < 19)
+      {
+        mantissa = mantissa * 10 + (*s - '0');
+        digits += mantissa != 0;
+        --exponent;
+      }
+  if (!any)
+    return false;
+
+  if (s < end && (*s == 'e' || *s == 'E'))
+  {
+    const char *e = s + 1;
+    bool negative_exponent = false;
+    if (e < end && (*e == '-' || *e == '+'))
+      negative_exponent = *e++ == '-';
+    if (e < end && is_digit(*e))
+    {
+      int n = 0;
+      for (; e < end && is_digit(*e); ++e)
+        n = std::min(n * 10 + (*e - '0'), 100000);
+      exponent += negative_exponent ? -n : n;
+      s = e;
+    }
+  }
+
+  double v = (double)mantissa;
+  if (mantissa == 0)
+    v = 0;
+  else if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22)
+    v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+  else if (exponent < -308)
+    v = v * 1e-300 * std::pow(10.0, exponent + 300); // (10^exponent itself is subnormal)
+  else
+    v *= std::pow(10.0, exponent);
+  value = negative ? -v : v;
+  p = s;
+  return true;
+}
+
+// Parses an integer ([+-]digits) from p, not past end, and moves p after it. Returns
+// false, with p unchanged, if there is none.
+inline bool parse_index(const char *&p, const char *end, long &value)
+{
+  const char *s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+  if (s == end || !is_digit(*s))
+    return false;
+  long n = 0;
+  for (; s < end && is_digit(*s); ++s)
+    if (n < (1l << 40)) // (beyond, it is out of range anyway)
+      n = n * 10 + (*s - '0');
+  value = negative ? -n : n;
+  p = s;
+  return true;
+}
+
+// Adds to the mesh the vertices ('v' lines) and the faces ('f' lines) of the Wavefront OBJ
+// text in [begin, end). The other lines (normals, texture coordinates, groups, comments...)
+// are ignored. The vertices of a face can have texture and normal indices (v/vt/vn), and
+// negative (relative) indices; faces of more than 3 vertices are split in a fan of
+// triangles. Faces with a vertex missing are left out. The arrays of the mesh are sized
+// first, from a count of the lines.
+inline void parse_obj(const char *begin, const char *end, Mesh &mesh, const minwin::Color &color = minwin::WHITE)
+{
+  // the vertex and face lines (faces of more than 3 vertices need more room)
+  size_t vertex_lines = 0, face_lines = 0;
+  for (const char *line = begin; line < end;)
+  {
+    const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+    if (end - line > 1 && (line[1] == ' ' || line[1] == '\t'))
+    {
+      vertex_lines += line[0] == 'v';
+      face_lines += line[0] == 'f';
+    }
+    line = eol != nullptr ? eol + 1 : end;
+  }
+  mesh.reserve(mesh.vertex_count() + vertex_lines, mesh.face_count() + face_lines);
+
+  size_t first_vertex = mesh.vertex_count(); // the vertex 1 of the file
+  auto is_space = [](char c)
+  { return c == ' ' || c == '\t' || c == '\r'; };
+  for (const char *line = begin; line < end;)
+  {
+    const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+    if (eol == nullptr)
+      eol = end;
+    const char *p = line;
+    line = eol + (eol < end);
+
+    while (p < eol && is_space(*p))
+      ++p;
+    if (eol - p < 2 || !is_space(p[1]) || (p[0] != 'v' && p[0] != 'f'))
+      continue;
+
+    if (p[0] == 'v')
+    {
+      // (missing coordinates are 0, so that the next vertices keep their index)
+      aline::real c[3] = {0, 0, 0};
+      ++p;
+      for (int k = 0; k < 3; ++k)
+      {
+        while (p < eol && is_space(*p))
+          ++p;
+        if (!parse_real(p, eol, c[k]))
+          break;
+      }
+      mesh.add_vertex(c[0], c[1], c[2]);
+      continue;
+    }
+
+    // a face: v, v/vt, v//vn or v/vt/vn for each vertex, checked before it is added
+    auto next_vertex = [&](const char *&q, long &vertex)
+    {
+      while (q < eol && is_space(*q))
+        ++q;
+      long index;
+      if (!parse_index(q, eol, index))
+        return false;
+      while (q < eol && !is_space(*q))
+        ++q;
+      vertex = index > 0 ? (long)first_vertex + index - 1 : (long)mesh.vertex_count() + index;
+      return index != 0 && vertex >= (long)first_vertex && vertex < (long)mesh.vertex_count();
+    };
+    const char *q = p + 1;
+    long vertex;
+    int count = 0;
+    while (next_vertex(q, vertex))
+      ++count;
+    while (q < eol && is_space(*q))
+      ++q;
+    if (count < 3 || (q < eol && *q != '#'))
+      continue;
+
+    long first, previous;
+    q = p + 1;
+    next_vertex(q, first);
+    next_vertex(q, previous);
+    for (int k = 2; k < count; ++k)
+    {
+      next_vertex(q, vertex);
+      mesh.add_face(first, previous, vertex, color);
+      previous = vertex;
+    }
+  }
+}
+
+// Adds to the mesh the vertices and faces of an OBJ file (see parse_obj), read through a
+// memory mapping. Returns false if the file could not be read.
+inline bool load_obj(const std::string &file_name, Mesh &mesh, const minwin::Color &color = minwin::WHITE)
+{
+  MappedFile file(file_name);
+  if (!file.is_open())
+    return false;
+  parse_obj(file.data(), file.data() + file.size(), mesh, color);
+  return true;
+}
+
+#endif
@@ -1,7 +1,11 @@
 #include "color.h"
+#include <algorithm>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "matrix.h"
+#include "quaternion.h"
+#include "mesh.h"
 
 class Vertex
 {
@@ -13,7 +17,7 @@ public:
   {
   }
 
-  inline aline::Vec3r get_vec() const
+  inline const aline::Vec3r &get_vec() const
   {
     return vec;
   }
@@ -50,67 +54,236 @@ public:
   }
 };
 
+// Bounds of a mesh: its axis-aligned bounding box, given by its center and half extents,
+// and the bounding sphere around the same center.
+struct Bounds
+{
+  aline::Vec3r center;
+  aline::Vec3r half_extents;
+  aline::real radius;
+};
+
 class Shape
 {
   std::string name;
-  std::vector<Vertex> vertices;
-  std::vector<Face> faces;
+  Mesh mesh;
+  Bounds bounds;
+  std::vector<uint32_t> edges;      // the vertices of each edge (2 per edge)
+  std::vector<uint32_t> face_edges; // the edges of each face (3 per face)
 
 public:
   Shape(const std::string &name, const std::vector<Vertex> &vertices, const std::vector<Face> &faces) : name(name)
   {
-    this->vertices = std::vector<Vertex>(vertices);
-    this->faces = std::vector<Face>(faces);
+    mesh.reserve(vertices.size(), faces.size());
+    for (const Vertex &v : vertices)
+      mesh.add_vertex(v.get_vec()[0], v.get_vec()[1], v.get_vec()[2]);
+    for (const Face &f : faces)
+      mesh.add_face(f.get_v0(), f.get_v1(), f.get_v2(), f.get_color());
+    bounds = compute_bounds(mesh);
+    build_edges();
   }
 
-  Shape(const Shape& shape)
+  Shape(const std::string &name, const Mesh &mesh) : name(name), mesh(mesh), bounds(compute_bounds(mesh))
+  {
+    build_edges();
+  }
+
+  Shape(const Shape& shape) : name(shape.get_name()), mesh(shape.get_mesh()), bounds(shape.get_bounds()),
+                              edges(shape.get_edges()), face_edges(shape.get_face_edges())
   {
-    this->name = shape.get_name();
-    this->vertices = std::vector<Vertex>(shape.get_vertices());
-    this->faces = std::vector<Face>(shape.get_faces());
   }
 
   // Returns the name of the face.
-  inline std::string get_name() const
+  inline const std::string &get_name() const
   {
     return name;
   }
-  // Returns the list of vertices.
-  inline std::vector<Vertex> get_vertices() const
+
+  // Returns the mesh (read-only view, not a copy).
+  inline const Mesh &get_mesh() const
+  {
+    return mesh;
+  }
+
+  // Returns the bounds of the mesh, in the shape's coordinates.
+  inline const Bounds &get_bounds() const
+  {
+    return bounds;
+  }
+
+  inline size_t edge_count() const
+  {
+    return edges.size() / 2;
+  }
+
+  // The edge buffer: the edge e goes from the vertex edges[2e] to edges[2e+1] (the lowest
+  // index first). Each edge is listed once, however many faces share it.
+  inline const std::vector<uint32_t> &get_edges() const
+  {
+    return edges;
+  }
+
+  // The edges of the faces: the face f has the edges face_edges[3f] (from its vertex 0 to
+  // its vertex 1), face_edges[3f+1] (1 to 2) and face_edges[3f+2] (2 to 0).
+  inline const std::vector<uint32_t> &get_face_edges() const
   {
-    return vertices;
+    return face_edges;
   }
 
-  // Returns the list of faces
-  inline std::vector<Face> get_faces() const
+private:
+  // Lists the edges of the mesh once each, by hashing the (sorted) pairs of vertices of
+  // the faces' sides.
+  void build_edges()
   {
-    return faces;
+    const std::vector<uint32_t> &indices = mesh.get_indices();
+    std::unordered_map<uint64_t, uint32_t> known;
+    // a closed mesh has 3/2 edges per face
+    known.reserve(indices.size() / 2);
+    edges.reserve(indices.size());
+    face_edges.resize(indices.size());
+    for (size_t f = 0; f < mesh.face_count(); ++f)
+      for (int k = 0; k < 3; ++k)
+      {
+        uint32_t a = indices[3 * f + k], b = indices[3 * f + (k + 1) % 3];
+        if (b < a)
+          std::swap(a, b);
+        auto inserted = known.insert({(uint64_t)a << 32 | b, (uint32_t)edge_count()});
+        if (inserted.second)
+        {
+          edges.push_back(a);
+          edges.push_back(b);
+        }
+        face_edges[3 * f + k] = inserted.first->second;
+      }
+    edges.shrink_to_fit();
+  }
+
+  static Bounds compute_bounds(const Mesh &mesh)
+  {
+    Bounds b{aline::Vec3r(), aline::Vec3r(), 0.0};
+    size_t n = mesh.vertex_count();
+    if (n == 0)
+      return b;
+
+    const CoordArray *coords[3] = {&mesh.get_x(), &mesh.get_y(), &mesh.get_z()};
+    for (int k = 0; k < 3; ++k)
+    {
+      auto range = std::minmax_element(coords[k]->begin(), coords[k]->end());
+      b.center[k] = (*range.first + *range.second) / 2;
+      b.half_extents[k] = (*range.second - *range.first) / 2;
+    }
+    // the sphere around the center of the box is smaller than the box's circumscribed one
+    for (size_t i = 0; i < n; ++i)
+      b.radius = std::max(b.radius, (aline::real)norm(mesh.get_vertex(i) - b.center));
+    return b;
   }
 };
 
 aline::Vec4r w({0.0,0.0,0.0,1.0});
 
+// Which faces of an object are skipped before rasterization. Front faces are those whose
+// vertices are counter-clockwise when seen from outside the (closed) mesh.
+enum CullMode
+{
+  cull_back,  // draws only the faces seen from the front
+  cull_front, // draws only the faces seen from behind
+  cull_none   // draws every face
+};
+
 class Object
 {
   const Shape* shape;
   aline::Vec3r translation;
-  aline::Vec3r rotation;
+  aline::Quaternion orientation;
   aline::Vec3r scale;
+  mutable aline::Mat44r transform_matrix; // cached transform matrix
+  mutable bool dirty;                     // true if transform_matrix is out of date
+  CullMode cull_mode;
 
 public:
-  Object(const Shape* shape, const aline::Vec3r &translation, const aline::Vec3r &rotation, const aline::Vec3r &scale) : shape(shape)
+  Object(const Shape* shape, const aline::Vec3r &translation, const aline::Vec3r &rotation, const aline::Vec3r &scale) : shape(shape), dirty(true), cull_mode(cull_back)
   {
     this->translation = aline::Vec3r(translation);
-    this->rotation = aline::Vec3r(rotation);
+    set_rotation(rotation);
     this->scale = aline::Vec3r(scale);
   }
 
+  const aline::Vec3r &get_translation() const{
+    return translation;
+  }
+
+  const aline::Quaternion &get_orientation() const{
+    return orientation;
+  }
+
+  const aline::Vec3r &get_scale() const{
+    return scale;
+  }
+
+  void set_translation(const aline::Vec3r &translation){
+    this->translation = translation;
+    dirty = true;
+  }
+
+  // Rotation angles (in degrees) around the x, y and z axes. The rotation matrix is then
+  // Rx(-x) * Ry(-y) * Rz(-z).
+  void set_rotation(const aline::Vec3r &rotation){
+    orientation = aline::conjugate(aline::Quaternion::from_euler_angles(
+        degrees_to_radians(rotation[0]), degrees_to_radians(rotation[1]), degrees_to_radians(rotation[2])));
+    dirty = true;
+  }
+
+  // The orientation, as a unit quaternion.
+  void set_orientation(const aline::Quaternion &orientation){
+    this->orientation = orientation;
+    dirty = true;
+  }
+
+  void set_scale(const aline::Vec3r &scale){
+    this->scale = scale;
+    dirty = true;
+  }
+
+  CullMode get_cull_mode() const{
+    return cull_mode;
+  }
+
+  // The faces skipped when drawing the object (back faces by default).
+  void set_cull_mode(CullMode mode){
+    cull_mode = mode;
+  }
+
+  // Tests if the object moved since its transform matrix was last built.
+  bool is_dirty() const{
+    return dirty;
+  }
+
   /*
-    Returns the transform matrix
+    Returns the transform matrix, rebuilt only if the object moved since the last call
 
     Transform matrix = translation * rotation * scaling
   */
-  aline::Mat44r transform(){
+  const aline::Mat44r &transform() const{
+    if (dirty)
+    {
+      transform_matrix = build_transform();
+      dirty = false;
+    }
+    return transform_matrix;
+  }
+
+  const Shape &get_shape() const{
+    return *shape;
+  }
+
+  // The mesh of an object (read-only view of the shape's mesh).
+  const Mesh &get_mesh() const
+  {
+    return shape->get_mesh();
+  }
+
+private:
+  aline::Mat44r build_transform() const{
 
     aline::Mat44r translation_matrix({
       {1.0, 0.0, 0.0, translation[0]},
@@ -119,15 +292,7 @@ public:
       {0.0, 0.0, 0.0, 1.0}
     });
 
-    aline::real alpha = degrees_to_radians(rotation[0]);
-    aline::real beta = degrees_to_radians(rotation[1]);
-    aline::real gamma = degrees_to_radians(rotation[2]);
-    aline::Mat44r rotation_matrix({
-      {cos(beta)*cos(gamma), cos(beta)*sin(gamma), -sin(beta), 0.0},
-      {sin(alpha)*sin(beta)*cos(gamma)-cos(alpha)*sin(gamma), sin(alpha)*sin(beta)*sin(gamma)+cos(alpha)*cos(gamma), sin(alpha)*cos(beta), 0.0},
-      {cos(alpha)*sin(beta)*cos(gamma)+sin(alpha)*sin(gamma), cos(alpha)*sin(beta)*sin(gamma)-sin(alpha)*cos(gamma), cos(alpha)*cos(beta), 0.0},
-      {0.0, 0.0, 0.0, 1.0}
-    });
+    aline::Mat44r rotation_matrix = aline::to_matrix44(orientation);
 
     aline::Mat44r scale_matrix({
       {scale[0], 0.0, 0.0, 0.0},
@@ -138,23 +303,6 @@ public:
     return (translation_matrix*rotation_matrix*scale_matrix);
   }
 
-  Shape get_shape() const{
-    return *shape;
-  }
-
-  //  The list of vertices of an object.
-  std::vector<Vertex> get_vertices()
-  {
-    return shape->get_vertices();
-  }
-
-  // The list of faces of an object
-  std::vector<Face> get_faces()
-  {
-    return shape->get_faces();
-  }
-
-private:
   aline::real degrees_to_radians(aline::real x) const{
     return x * (M_PI / 180);
   }
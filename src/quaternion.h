@@ -0,0 +1,160 @@
+#include <cmath>
+#include "matrix.h"
+
+#ifndef QUATERNION_H
+
+#define QUATERNION_H
+
+namespace aline
+{
+  /*
+    A quaternion w + xi + yj + zk. Unit quaternions represent rotations: the rotation of
+    angle a around the unit axis u is cos(a/2) + sin(a/2)(u.x i + u.y j + u.z k), and the
+    product p * q is the rotation q followed by the rotation p.
+  */
+  class Quaternion
+  {
+  public:
+    real w, x, y, z;
+
+    // Constructs the identity (no rotation).
+    Quaternion() : w(1), x(0), y(0), z(0)
+    {
+    }
+
+    Quaternion(real w, real x, real y, real z) : w(w), x(x), y(y), z(z)
+    {
+    }
+
+    // The rotation of the given angle (in radians) around the given axis. The axis must
+    // be a unit vector.
+    static Quaternion from_axis_angle(const Vec3r &axis, real angle)
+    {
+      real s = sin(angle / 2);
+      return Quaternion(cos(angle / 2), axis[0] * s, axis[1] * s, axis[2] * s);
+    }
+
+    // The rotation of the angles (in radians) alpha around x, then beta around y, then
+    // gamma around z, i.e. Rz(gamma) * Ry(beta) * Rx(alpha) as matrices.
+    static Quaternion from_euler_angles(real alpha, real beta, real gamma)
+    {
+      real ca = cos(alpha / 2), sa = sin(alpha / 2);
+      real cb = cos(beta / 2), sb = sin(beta / 2);
+      real cg = cos(gamma / 2), sg = sin(gamma / 2);
+      return Quaternion(cg * cb * ca + sg * sb * sa,
+                        cg * cb * sa - sg * sb * ca,
+                        cg * sb * ca + sg * cb * sa,
+                        sg * cb * ca - cg * sb * sa);
+    }
+  };
+
+  // The product (composition) of two quaternions: the rotation q followed by p.
+  inline Quaternion operator*(const Quaternion &p, const Quaternion &q)
+  {
+    return Quaternion(p.w * q.w - p.x * q.x - p.y * q.y - p.z * q.z,
+                      p.w * q.x + p.x * q.w + p.y * q.z - p.z * q.y,
+                      p.w * q.y - p.x * q.z + p.y * q.w + p.z * q.x,
+                      p.w * q.z + p.x * q.y - p.y * q.x + p.z * q.w);
+  }
+
+  // The conjugate of a quaternion, which is the inverse rotation for unit quaternions.
+  inline Quaternion conjugate(const Quaternion &q)
+  {
+    return Quaternion(q.w, -q.x, -q.y, -q.z);
+  }
+
+  // The dot product of two quaternions (as 4-vectors).
+  inline real dot(const Quaternion &p, const Quaternion &q)
+  {
+    return p.w * q.w + p.x * q.x + p.y * q.y + p.z * q.z;
+  }
+
+  // The norm (magnitude) of a quaternion.
+  inline real norm(const Quaternion &q)
+  {
+    return sqrt(dot(q, q));
+  }
+
+  // The quaternion normalized. Products of unit quaternions slowly drift away from unit
+  // length, so repeated compositions should be normalized from time to time.
+  inline Quaternion normalize(const Quaternion &q)
+  {
+    real n = 1 / norm(q);
+    return Quaternion(q.w * n, q.x * n, q.y * n, q.z * n);
+  }
+
+  // Tests if two quaternions contain nearly equal values (see nearly_equal for vectors).
+  inline bool nearly_equal(const Quaternion &p, const Quaternion &q)
+  {
+    return nearly_equal(Vector<real, 4>({p.w, p.x, p.y, p.z}), Vector<real, 4>({q.w, q.x, q.y, q.z}));
+  }
+
+  // The vector v rotated by a unit quaternion (same as to_matrix33(q) * v).
+  inline Vec3r rotate(const Quaternion &q, const Vec3r &v)
+  {
+    // v + 2w (u x v) + 2 u x (u x v), where u is the vector part of q
+    Vec3r u{q.x, q.y, q.z};
+    Vec3r t = cross(u, v) * 2.0;
+    return v + t * q.w + cross(u, t);
+  }
+
+  // The spherical linear interpolation between two unit quaternions: p for t = 0, q for
+  // t = 1 and a rotation at constant angular speed in between (along the shortest path).
+  inline Quaternion slerp(const Quaternion &p, const Quaternion &q, real t)
+  {
+    real d = dot(p, q);
+    real sign = 1;
+    if (d < 0)
+    {
+      // q and -q are the same rotation, take the closest one
+      d = -d;
+      sign = -1;
+    }
+
+    real a, b;
+    if (d > 0.9995)
+    {
+      // nearly the same rotation: linear interpolation (normalized below)
+      a = 1 - t;
+      b = t;
+    }
+    else
+    {
+      real theta = acos(d);
+      real s = sin(theta);
+      a = sin((1 - t) * theta) / s;
+      b = sin(t * theta) / s;
+    }
+    b *= sign;
+    return normalize(Quaternion(a * p.w + b * q.w, a * p.x + b * q.x, a * p.y + b * q.y, a * p.z + b * q.z));
+  }
+
+  // The rotation matrix of a unit quaternion.
+  inline Mat33r to_matrix33(const Quaternion &q)
+  {
+    real xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    real xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    real wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    return Mat33r({{1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy)},
+                   {2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx)},
+                   {2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy)}});
+  }
+
+  // The rotation matrix of a unit quaternion, in homogeneous coordinates.
+  inline Mat44r to_matrix44(const Quaternion &q)
+  {
+    Mat33r r = to_matrix33(q);
+    return Mat44r({{r[0][0], r[0][1], r[0][2], 0.0},
+                   {r[1][0], r[1][1], r[1][2], 0.0},
+                   {r[2][0], r[2][1], r[2][2], 0.0},
+                   {0.0, 0.0, 0.0, 1.0}});
+  }
+
+  // Output operator.
+  inline std::ostream &operator<<(std::ostream &out, const Quaternion &q)
+  {
+    return out << "(" << q.w << ", " << q.x << ", " << q.y << ", " << q.z << ")";
+  }
+}
+
+#endif
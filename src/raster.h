@@ -0,0 +1,645 @@
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "framebuffer.h"
+#include "jobs.h"
+#include "vector.h"
+
+#ifndef RASTER_H
+
+#define RASTER_H
+
+// size (in pixels) of the square blocks tested at once by the edge function rasterizer
+#define RASTER_BLOCK 8
+// size (in pixels) of the square tiles of the tiled rasterizer
+#define RASTER_TILE 64
+// number of fractional bits of the (fixed point) window coordinates of filled triangles:
+// vertices are placed at 1/RASTER_SUBPIXEL of a pixel (28.4 fixed point)
+#define RASTER_SUBPIXEL_BITS 4
+#define RASTER_SUBPIXEL (1 << RASTER_SUBPIXEL_BITS)
+
+// A rectangle of pixels, bounds included.
+struct PixelRect
+{
+  int min_x, min_y, max_x, max_y;
+};
+
+// The floor of a / b, for b > 0.
+inline int64_t floor_div(int64_t a, int64_t b)
+{
+  return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+
+// The pixel containing a point given in fixed point window coordinates (the center of
+// the pixel (x, y) is at (x, y)).
+inline aline::Vec2i subpixel_to_pixel(const aline::Vec2i &p)
+{
+  return aline::Vec2i({(int)floor_div((int64_t)p[0] + RASTER_SUBPIXEL / 2, RASTER_SUBPIXEL),
+                       (int)floor_div((int64_t)p[1] + RASTER_SUBPIXEL / 2, RASTER_SUBPIXEL)});
+}
+
+// The edge equation E(X, Y) = a X + b Y + c of the line from p to q (fixed point window
+// coordinates, y axis down). E is positive on the right of the line going from p to q,
+// zero on it and negative on its left.
+//
+// Pixels whose center is on an edge follow the top-left rule: they are inside only if
+// the edge is a top edge (horizontal, with the triangle below) or a left edge (with the
+// triangle on its right), so that a pixel on the edge shared by two triangles is drawn
+// once. For this, the equation must be oriented with the triangle on its positive side.
+struct EdgeEquation
+{
+  int64_t a, b, c;
+  int64_t bias; // subtracted from E at pixel centers: 1 for the edges whose pixels are outside
+
+  EdgeEquation(const aline::Vec2i &p, const aline::Vec2i &q)
+      : a((int64_t)p[1] - q[1]), b((int64_t)q[0] - p[0]), c((int64_t)p[0] * q[1] - (int64_t)p[1] * q[0]),
+        bias(a > 0 || (a == 0 && b > 0) ? 0 : 1)
+  {
+  }
+
+  // E at a point (in fixed point window coordinates).
+  inline int64_t value(int64_t x, int64_t y) const
+  {
+    return a * x + b * y + c;
+  }
+
+  // E at the center of the pixel (x, y), minus the bias: the pixel is inside if it is
+  // positive or zero.
+  inline int64_t at(int x, int y) const
+  {
+    return value((int64_t)x * RASTER_SUBPIXEL, (int64_t)y * RASTER_SUBPIXEL) - bias;
+  }
+
+  // The number of corners of the block [x0, x1] x [y0, y1] on the positive side of (or
+  // on) the edge.
+  inline int corners_inside(int x0, int y0, int x1, int y1) const
+  {
+    return (at(x0, y0) >= 0) + (at(x1, y0) >= 0) + (at(x0, y1) >= 0) + (at(x1, y1) >= 0);
+  }
+
+  // The smallest value of the equation (minus the bias) on the block [x0, x1] x [y0, y1],
+  // which is at one of its corners.
+  inline int64_t min_at(int x0, int y0, int x1, int y1) const
+  {
+    return std::min(std::min(at(x0, y0), at(x1, y0)), std::min(at(x0, y1), at(x1, y1)));
+  }
+
+  // The change of the equation between two pixels along the minor axis of the edge (y
+  // for mostly horizontal edges, x otherwise): the pixels inside with a value below it are
+  // those next to the edge, one per row or column.
+  inline int64_t pixel_band() const
+  {
+    return std::max(std::abs(a), std::abs(b)) * RASTER_SUBPIXEL;
+  }
+};
+
+// Bits of the outline of a filled triangle (see fill_triangle): the sides of the triangle
+// drawn as edges, the side k going from its vertex k to its vertex k + 1 (mod 3).
+enum OutlineBits
+{
+  outline_side0 = 1,
+  outline_side1 = 2,
+  outline_side2 = 4,
+  outline_sides = 7,
+  outline_shared0 = 8, // (the side is shared with another drawn triangle)
+  outline_shared1 = 16,
+  outline_shared2 = 32
+};
+
+/*
+  A depth buffer. Each pixel stores the reciprocal of the depth (1/z, in camera space) of
+  the nearest surface drawn on it, or 0 if nothing was drawn: larger values are nearer.
+  Unlike z, 1/z varies linearly in screen space, so interpolating it over a triangle with
+  the edge equations gives the exact (perspective correct) depth of each pixel.
+
+  It is also a 2-level hierarchical Z: for each block of RASTER_BLOCK x RASTER_BLOCK pixels
+  it keeps bounds of the range of their values and for each tile of RASTER_TILE x
+  RASTER_TILE pixels a bound of the farthest one, so that hidden parts of triangles are
+  rejected without reading pixels.
+*/
+class DepthBuffer
+{
+  int width, height;
+  int blocks_x, blocks_y;
+  int tiles_x, tiles_y;
+  std::vector<float> depths;
+  std::vector<float> block_min, block_max; // farthest and nearest value of each block
+  std::vector<float> tile_min;             // farthest value of each tile
+
+public:
+  DepthBuffer(int width, int height)
+      : width(width), height(height),
+        blocks_x((width + RASTER_BLOCK - 1) / RASTER_BLOCK), blocks_y((height + RASTER_BLOCK - 1) / RASTER_BLOCK),
+        tiles_x((width + RASTER_TILE - 1) / RASTER_TILE), tiles_y((height + RASTER_TILE - 1) / RASTER_TILE),
+        depths((size_t)width * height, 0.0f),
+        block_min((size_t)blocks_x * blocks_y, 0.0f), block_max((size_t)blocks_x * blocks_y, 0.0f),
+        tile_min((size_t)tiles_x * tiles_y, 0.0f)
+  {
+  }
+
+  inline int get_width() const
+  {
+    return width;
+  }
+
+  inline int get_height() const
+  {
+    return height;
+  }
+
+  // Forgets every drawn surface.
+  void clear()
+  {
+    std::fill(depths.begin(), depths.end(), 0.0f);
+    std::fill(block_min.begin(), block_min.end(), 0.0f);
+    std::fill(block_max.begin(), block_max.end(), 0.0f);
+    std::fill(tile_min.begin(), tile_min.end(), 0.0f);
+  }
+
+  // Returns the values, row by row.
+  inline float *data()
+  {
+    return depths.data();
+  }
+
+  inline float get_depth(int x, int y) const
+  {
+    return depths[(size_t)y * width + x];
+  }
+
+  // The farthest and nearest values of the block (bx, by).
+  inline float block_farthest(int bx, int by) const
+  {
+    return block_min[(size_t)by * blocks_x + bx];
+  }
+
+  inline float block_nearest(int bx, int by) const
+  {
+    return block_max[(size_t)by * blocks_x + bx];
+  }
+
+  // The farthest value of the tile (tx, ty).
+  inline float tile_farthest(int tx, int ty) const
+  {
+    return tile_min[(size_t)ty * tiles_x + tx];
+  }
+
+  // Records that the value new_value was written in the block (bx, by).
+  inline void write_block(int bx, int by, float new_value)
+  {
+    float &hi = block_max[(size_t)by * blocks_x + bx];
+    hi = std::max(hi, new_value);
+  }
+
+  // Records that every pixel of the block (bx, by) now holds a value no farther than the
+  // given one. (Values only get nearer, so until a block is fully covered its previous
+  // farthest value is still a valid bound.)
+  inline void cover_block(int bx, int by, float farthest)
+  {
+    float &lo = block_min[(size_t)by * blocks_x + bx];
+    lo = std::max(lo, farthest);
+  }
+
+  // Updates the farthest value of the tile (tx, ty) from the ones of its blocks.
+  void update_tile(int tx, int ty)
+  {
+    const int blocks_per_tile = RASTER_TILE / RASTER_BLOCK;
+    int bx1 = std::min((tx + 1) * blocks_per_tile, blocks_x), by1 = std::min((ty + 1) * blocks_per_tile, blocks_y);
+    float lo = block_min[(size_t)ty * blocks_per_tile * blocks_x + tx * blocks_per_tile];
+    for (int j = ty * blocks_per_tile; j < by1; ++j)
+      for (int i = tx * blocks_per_tile; i < bx1; ++i)
+        lo = std::min(lo, block_min[(size_t)j * blocks_x + i]);
+    tile_min[(size_t)ty * tiles_x + tx] = lo;
+  }
+};
+
+/*
+  Fills a triangle with the pixels of its bounding box (clipped to the given rectangle)
+  whose center is inside the triangle (see EdgeEquation for the pixels on its edges) and
+  in front of the surfaces already in the depth buffer, calling plot(x, y, n) for each run
+  of n of them from (x, y) on a row. The vertices are given in fixed point window
+  coordinates (see RASTER_SUBPIXEL), z0, z1 and z2 are their reciprocal depths (see
+  DepthBuffer).
+
+  The outline gives the sides of the triangle drawn as edges (see OutlineBits): the pixels
+  next to them, one per row or column inside the triangle, are plotted with
+  plot_edge(x, y, n) instead, so that edges are hidden like the faces. A side shared with
+  another drawn triangle is only drawn by the one where it is a top or left edge (see
+  EdgeEquation), so that it is one pixel wide too.
+
+  The triangle is first skipped if it is behind the farthest surface of every tile it
+  overlaps. Then its box is walked by blocks of RASTER_BLOCK x RASTER_BLOCK pixels: as the
+  equations are linear, testing the corners of a block tells if it is fully outside the
+  triangle or behind the block's farthest surface (skipped), or fully inside the triangle
+  or in front of the block's nearest surface (no test needed). The blocks with neither
+  test are plotted by whole rows. Otherwise, the equations and the depth are updated
+  incrementally per pixel, the equations in 32 bit integers: only the edges across the
+  block are tested, and their values in a block are small. The written pixels next to
+  each other on a row, within a block and across the blocks, are plotted as one run.
+*/
+template <class Plot, class PlotEdge>
+void fill_triangle(aline::Vec2i p0, aline::Vec2i p1, aline::Vec2i p2, float z0, float z1, float z2, int outline,
+                   const PixelRect &clip, DepthBuffer &depth, Plot plot, PlotEdge plot_edge)
+{
+  // orient the triangle so that its inside is on the positive side of the edges
+  int64_t area = EdgeEquation(p0, p1).value(p2[0], p2[1]);
+  if (area == 0)
+    return; // degenerate, only its outline can be seen
+  bool swapped = area < 0;
+  if (swapped)
+  {
+    std::swap(p1, p2);
+    std::swap(z1, z2);
+    area = -area;
+  }
+  EdgeEquation e0(p1, p2), e1(p2, p0), e2(p0, p1);
+
+  // the pixels whose center is in the bounding box
+  int min_x = std::max((int)-floor_div(-std::min(std::min(p0[0], p1[0]), p2[0]), RASTER_SUBPIXEL), std::max(clip.min_x, 0));
+  int min_y = std::max((int)-floor_div(-std::min(std::min(p0[1], p1[1]), p2[1]), RASTER_SUBPIXEL), std::max(clip.min_y, 0));
+  int max_x = std::min((int)floor_div(std::max(std::max(p0[0], p1[0]), p2[0]), RASTER_SUBPIXEL),
+                       std::min(clip.max_x, depth.get_width() - 1));
+  int max_y = std::min((int)floor_div(std::max(std::max(p0[1], p1[1]), p2[1]), RASTER_SUBPIXEL),
+                       std::min(clip.max_y, depth.get_height() - 1));
+  if (min_x > max_x || min_y > max_y)
+    return;
+
+  // hierarchical Z, at the tile level
+  float z_min = std::min(std::min(z0, z1), z2), z_max = std::max(std::max(z0, z1), z2);
+  bool visible = false;
+  for (int ty = min_y / RASTER_TILE; ty <= max_y / RASTER_TILE && !visible; ++ty)
+    for (int tx = min_x / RASTER_TILE; tx <= max_x / RASTER_TILE && !visible; ++tx)
+      visible = z_max > depth.tile_farthest(tx, ty);
+  if (!visible)
+    return;
+
+  // the depth is the barycentric interpolation of the vertices depths, itself linear:
+  // z(x, y) = zx x + zy y + zc at the center of the pixel (x, y)
+  double zx = ((double)e0.a * z0 + (double)e1.a * z1 + (double)e2.a * z2) * RASTER_SUBPIXEL / area;
+  double zy = ((double)e0.b * z0 + (double)e1.b * z1 + (double)e2.b * z2) * RASTER_SUBPIXEL / area;
+  double zc = ((double)e0.c * z0 + (double)e1.c * z1 + (double)e2.c * z2) / area;
+  const EdgeEquation *edges[3] = {&e0, &e1, &e2};
+
+  // the sides of the original triangle the edges are, and the width of the outlined ones
+  // (0 for the others)
+  const int sides[2][3] = {{1, 2, 0}, {1, 0, 2}};
+  int64_t band[3];
+  for (int k = 0; k < 3; ++k)
+  {
+    int side = sides[swapped][k];
+    bool outlined = (outline >> side & 1) && (!(outline >> (side + 3) & 1) || edges[k]->bias == 0);
+    band[k] = outlined ? edges[k]->pixel_band() : 0;
+  }
+
+  float *depths = depth.data();
+  int width = depth.get_width();
+  bool covered = false; // whether the farthest value of a block got nearer
+
+  // the written pixels of each row of the current row of blocks are joined in runs
+  // (across the blocks), plotted once they end: their first pixel, length and whether
+  // they are edge pixels
+  int run_x[RASTER_BLOCK], run_n[RASTER_BLOCK] = {};
+  bool run_edge[RASTER_BLOCK];
+  auto end_run = [&](int y)
+  {
+    int r = y % RASTER_BLOCK;
+    if (run_n[r] == 0)
+      return;
+    if (run_edge[r])
+      plot_edge(run_x[r], y, run_n[r]);
+    else
+      plot(run_x[r], y, run_n[r]);
+    run_n[r] = 0;
+  };
+  auto add_run = [&](int x, int y, int n, bool is_edge)
+  {
+    int r = y % RASTER_BLOCK;
+    if (run_n[r] > 0 && run_x[r] + run_n[r] == x && run_edge[r] == is_edge)
+    {
+      run_n[r] += n;
+      return;
+    }
+    end_run(y);
+    run_x[r] = x;
+    run_n[r] = n;
+    run_edge[r] = is_edge;
+  };
+
+  for (int by = min_y - min_y % RASTER_BLOCK; by <= max_y; by += RASTER_BLOCK)
+  {
+    int y0 = std::max(by, min_y), y1 = std::min(by + RASTER_BLOCK - 1, max_y);
+    for (int bx = min_x - min_x % RASTER_BLOCK; bx <= max_x; bx += RASTER_BLOCK)
+    {
+      int x0 = std::max(bx, min_x), x1 = std::min(bx + RASTER_BLOCK - 1, max_x);
+
+      int corners[3];
+      for (int k = 0; k < 3; ++k)
+        corners[k] = edges[k]->corners_inside(x0, y0, x1, y1);
+      if (corners[0] == 0 || corners[1] == 0 || corners[2] == 0)
+        continue;
+      int inside = std::min(std::min(corners[0], corners[1]), corners[2]);
+
+      // depth range of the triangle on the block (at its corners, within the vertices range)
+      double c00 = zx * x0 + zy * y0 + zc, c10 = c00 + zx * (x1 - x0);
+      double c01 = c00 + zy * (y1 - y0), c11 = c10 + zy * (y1 - y0);
+      double block_z_max = std::min<double>(std::max(std::max(c00, c10), std::max(c01, c11)), z_max);
+      double block_z_min = std::max<double>(std::min(std::min(c00, c10), std::min(c01, c11)), z_min);
+      int block_x = bx / RASTER_BLOCK, block_y = by / RASTER_BLOCK;
+      if (block_z_max <= depth.block_farthest(block_x, block_y))
+        continue; // hidden
+      bool test_depth = block_z_min <= depth.block_nearest(block_x, block_y);
+
+      // the pixels of the block are all covered (so that its farthest value is known)
+      bool full_block = inside == 4 && x0 == bx && y0 == by &&
+                        x1 == std::min(bx + RASTER_BLOCK, depth.get_width()) - 1 &&
+                        y1 == std::min(by + RASTER_BLOCK, depth.get_height()) - 1;
+
+      // the values of the edges across the block (the others are replaced by 0): as one
+      // corner is on each side, they fit in 32 bits
+      int32_t w_row[3], step_x[3], step_y[3];
+      for (int k = 0; k < 3; ++k)
+      {
+        bool across = corners[k] < 4;
+        w_row[k] = across ? (int32_t)edges[k]->at(x0, y0) : 0;
+        step_x[k] = across ? (int32_t)(edges[k]->a * RASTER_SUBPIXEL) : 0;
+        step_y[k] = across ? (int32_t)(edges[k]->b * RASTER_SUBPIXEL) : 0;
+      }
+
+      // the same, minus the band, for the outlined edges with pixels next to them in the
+      // block (negative next to the edge)
+      bool edge_block = false;
+      int32_t o_row[3] = {0, 0, 0}, o_step_x[3] = {0, 0, 0}, o_step_y[3] = {0, 0, 0};
+      for (int k = 0; k < 3; ++k)
+        if (band[k] > 0 && edges[k]->min_at(x0, y0, x1, y1) < band[k])
+        {
+          edge_block = true;
+          o_row[k] = (int32_t)(edges[k]->at(x0, y0) - band[k]);
+          o_step_x[k] = (int32_t)(edges[k]->a * RASTER_SUBPIXEL);
+          o_step_y[k] = (int32_t)(edges[k]->b * RASTER_SUBPIXEL);
+        }
+
+      bool written = false;
+      int n = x1 - x0 + 1;
+      double z_row = c00;
+      bool span_block = inside == 4 && !test_depth && !edge_block;
+      if (span_block)
+      {
+        // every pixel is written: the rows are filled as spans
+        for (int y = y0; y <= y1; ++y, z_row += zy)
+        {
+          // (independent iterations, which the compiler can vectorize)
+          float *d = depths + (size_t)y * width + x0;
+          for (int i = 0; i < n; ++i)
+            d[i] = (float)(z_row + i * zx);
+          add_run(x0, y, n, false);
+        }
+        written = true;
+      }
+      for (int y = y0; y <= y1 && !span_block; ++y)
+      {
+        // coverage of the row (independent iterations, which the compiler can vectorize)
+        int32_t coverage[RASTER_BLOCK], edge[RASTER_BLOCK];
+        for (int i = 0; i < n; ++i)
+          coverage[i] = (w_row[0] + i * step_x[0]) | (w_row[1] + i * step_x[1]) | (w_row[2] + i * step_x[2]);
+        if (edge_block)
+          for (int i = 0; i < n; ++i)
+            edge[i] = (o_row[0] + i * o_step_x[0]) | (o_row[1] + i * o_step_x[1]) | (o_row[2] + i * o_step_x[2]);
+
+        double z = z_row;
+        float *d = depths + (size_t)y * width + x0;
+        for (int i = 0; i < n; ++i, z += zx)
+        {
+          if (coverage[i] >= 0 && (!test_depth || z > d[i]))
+          {
+            d[i] = (float)z;
+            add_run(x0 + i, y, 1, edge_block && edge[i] < 0);
+            written = true;
+          }
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+          w_row[k] += step_y[k];
+          o_row[k] += o_step_y[k];
+        }
+        z_row += zy;
+      }
+      if (!written)
+        continue;
+      // (rounded up, as the written values are rounded to float)
+      depth.write_block(block_x, block_y, std::nextafter((float)block_z_max, FLT_MAX));
+      if (full_block)
+      {
+        // (the values of a span block are linear: the farthest is at a corner, rounded
+        // down for the rounding of the values between)
+        float farthest = FLT_MAX;
+        if (span_block)
+          farthest = std::nextafter((float)std::min(std::min(c00, c10), std::min(c01, c11)), -FLT_MAX);
+        else
+          for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+              farthest = std::min(farthest, depths[(size_t)y * width + x]);
+        if (farthest > depth.block_farthest(block_x, block_y))
+        {
+          depth.cover_block(block_x, block_y, farthest);
+          covered = true;
+        }
+      }
+    }
+    for (int y = y0; y <= y1; ++y)
+      end_run(y);
+  }
+
+  if (covered)
+    for (int ty = min_y / RASTER_TILE; ty <= max_y / RASTER_TILE; ++ty)
+      for (int tx = min_x / RASTER_TILE; tx <= max_x / RASTER_TILE; ++tx)
+        depth.update_tile(tx, ty);
+}
+
+// Fills a triangle, without outline (see above).
+template <class Plot>
+void fill_triangle(const aline::Vec2i &p0, const aline::Vec2i &p1, const aline::Vec2i &p2, float z0, float z1, float z2,
+                   const PixelRect &clip, DepthBuffer &depth, Plot plot)
+{
+  fill_triangle(p0, p1, p2, z0, z1, z2, 0, clip, depth, plot, plot);
+}
+
+// Draws a line from p0 to p1 with Bresenham's algorithm, calling plot(x, y) for each of its
+// pixels in the given rectangle. The line is clipped to the rectangle first, so that its
+// cost only depends on its visible pixels: the pixel i (along the major axis, of length n)
+// is at the offset floor((2 d i + n) / 2n) along the minor axis (of length d), so the
+// pixels in the rectangle are found directly, and are exactly those of the whole line.
+template <class Plot>
+void draw_line(const aline::Vec2i &p0, const aline::Vec2i &p1, const PixelRect &clip, Plot plot)
+{
+  int x0 = p0[0], y0 = p0[1];
+  int x1 = p1[0], y1 = p1[1];
+
+  // fast paths for horizontal and vertical lines
+  if (y0 == y1)
+  {
+    if (y0 < clip.min_y || y0 > clip.max_y)
+      return;
+    int from = std::max(std::min(x0, x1), clip.min_x), to = std::min(std::max(x0, x1), clip.max_x);
+    for (int x = from; x <= to; ++x)
+      plot(x, y0);
+    return;
+  }
+  if (x0 == x1)
+  {
+    if (x0 < clip.min_x || x0 > clip.max_x)
+      return;
+    int from = std::max(std::min(y0, y1), clip.min_y), to = std::min(std::max(y0, y1), clip.max_y);
+    for (int y = from; y <= to; ++y)
+      plot(x0, y);
+    return;
+  }
+
+  // major axis a and minor axis b, with the steps sa and sb
+  bool x_major = abs(x1 - x0) >= abs(y1 - y0);
+  int64_t a0 = x_major ? x0 : y0, b0 = x_major ? y0 : x0;
+  int64_t a1 = x_major ? x1 : y1, b1 = x_major ? y1 : x1;
+  int64_t sa = a0 < a1 ? 1 : -1, sb = b0 < b1 ? 1 : -1;
+  int64_t n = (a1 - a0) * sa, d = (b1 - b0) * sb;
+  int64_t min_a = x_major ? clip.min_x : clip.min_y, max_a = x_major ? clip.max_x : clip.max_y;
+  int64_t min_b = x_major ? clip.min_y : clip.min_x, max_b = x_major ? clip.max_y : clip.max_x;
+
+  // range [first, last] of the pixels inside along the major axis...
+  int64_t first = sa > 0 ? min_a - a0 : a0 - max_a;
+  int64_t last = sa > 0 ? max_a - a0 : a0 - min_a;
+  // ... and along the minor axis (offsets lo to hi from b0)
+  int64_t lo = sb > 0 ? min_b - b0 : b0 - max_b;
+  int64_t hi = sb > 0 ? max_b - b0 : b0 - min_b;
+  lo = std::max(lo, (int64_t)0);
+  hi = std::min(hi, d);
+  // offset(i) >= lo  <=>  2 d i + n >= 2 n lo, offset(i) <= hi  <=>  2 d i + n < 2 n (hi + 1)
+  first = std::max(first, -floor_div(n - 2 * n * lo, 2 * d));
+  last = std::min(last, floor_div(2 * n * (hi + 1) - n - 1, 2 * d));
+  first = std::max(first, (int64_t)0);
+  last = std::min(last, n);
+  if (first > last)
+    return;
+
+  // the error term of Bresenham's algorithm at the first pixel
+  int64_t offset = floor_div(2 * d * first + n, 2 * n);
+  int64_t error = 2 * d * first + n - 2 * n * offset;
+  int64_t a = a0 + sa * first, b = b0 + sb * offset;
+  for (int64_t i = first; i <= last; ++i)
+  {
+    if (x_major)
+      plot((int)a, (int)b);
+    else
+      plot((int)b, (int)a);
+    a += sa;
+    error += 2 * d;
+    if (error >= 2 * n)
+    {
+      error -= 2 * n;
+      b += sb;
+    }
+  }
+}
+
+// A filled triangle or a line (from p0 to p1, with p2 = p1) in window coordinates, as
+// queued for the tiled rasterizer.
+struct ScreenTriangle
+{
+  aline::Vec2i p0, p1, p2; // in fixed point (see RASTER_SUBPIXEL)
+  float z0, z1, z2; // reciprocal depths of the vertices (filled triangles only)
+  uint32_t color;
+  bool filled;
+  uint8_t outline;        // outlined sides of a filled triangle (see OutlineBits)
+  uint32_t outline_color;
+};
+
+/*
+  Rasterizes a list of triangles into a framebuffer, in parallel. The framebuffer is cut
+  into RASTER_TILE x RASTER_TILE tiles and each triangle is added to the bin of every tile
+  its bounding box overlaps. The threads of a job system then take ranges of whole tiles
+  and draw their bins in order, clipped to the tile. A tile is drawn by a single thread,
+  which is the only one writing its pixels and depths: no locks are needed and the image
+  is the same as a serial one.
+*/
+class TiledRasterizer
+{
+  int width, height;
+  int tiles_x, tiles_y;
+  std::vector<std::vector<uint32_t>> bins; // indices of the triangles overlapping each tile
+
+public:
+  TiledRasterizer(int width, int height)
+      : width(width), height(height),
+        tiles_x((width + RASTER_TILE - 1) / RASTER_TILE), tiles_y((height + RASTER_TILE - 1) / RASTER_TILE),
+        bins((size_t)tiles_x * tiles_y)
+  {
+  }
+
+  int get_tile_count() const
+  {
+    return tiles_x * tiles_y;
+  }
+
+  // Sorts the triangles into the bins of the tiles they overlap.
+  void bin(const std::vector<ScreenTriangle> &triangles)
+  {
+    for (std::vector<uint32_t> &b : bins)
+      b.clear();
+
+    for (size_t i = 0; i < triangles.size(); ++i)
+    {
+      const ScreenTriangle &t = triangles[i];
+      // (pixels of the fill or of the line)
+      int min_x = std::max((int)floor_div(std::min(std::min(t.p0[0], t.p1[0]), t.p2[0]), RASTER_SUBPIXEL), 0);
+      int min_y = std::max((int)floor_div(std::min(std::min(t.p0[1], t.p1[1]), t.p2[1]), RASTER_SUBPIXEL), 0);
+      int max_x = std::min((int)floor_div(std::max(std::max(t.p0[0], t.p1[0]), t.p2[0]) + RASTER_SUBPIXEL / 2, RASTER_SUBPIXEL), width - 1);
+      int max_y = std::min((int)floor_div(std::max(std::max(t.p0[1], t.p1[1]), t.p2[1]) + RASTER_SUBPIXEL / 2, RASTER_SUBPIXEL), height - 1);
+      for (int ty = min_y / RASTER_TILE; ty <= max_y / RASTER_TILE && min_y <= max_y; ++ty)
+        for (int tx = min_x / RASTER_TILE; tx <= max_x / RASTER_TILE && min_x <= max_x; ++tx)
+          bins[(size_t)ty * tiles_x + tx].push_back(i);
+    }
+  }
+
+  // Draws the binned triangles with the threads of the job system (the calling one
+  // included). Filled triangles are tested against the depth buffer.
+  void draw(const std::vector<ScreenTriangle> &triangles, FrameBuffer &fb, DepthBuffer &depth, JobSystem &jobs)
+  {
+    jobs.parallel_for(0, get_tile_count(), 1, [&](size_t begin, size_t end)
+                      {
+                        for (size_t tile = begin; tile < end; ++tile)
+                          draw_tile(tile, triangles, fb, depth);
+                      });
+  }
+
+private:
+  void draw_tile(int tile, const std::vector<ScreenTriangle> &triangles, FrameBuffer &fb, DepthBuffer &depth) const
+  {
+    const std::vector<uint32_t> &bin = bins[tile];
+    if (bin.empty())
+      return;
+
+    int tx = tile % tiles_x, ty = tile / tiles_x;
+    PixelRect clip{tx * RASTER_TILE, ty * RASTER_TILE,
+                   std::min((tx + 1) * RASTER_TILE, width) - 1, std::min((ty + 1) * RASTER_TILE, height) - 1};
+    uint32_t *pixels = fb.data();
+    int w = fb.get_width();
+
+    for (uint32_t i : bin)
+    {
+      const ScreenTriangle &t = triangles[i];
+      uint32_t color = t.color;
+      uint32_t outline_color = t.outline_color;
+      auto plot = [=](int x, int y, int n)
+      { fill_span(pixels + (size_t)y * w + x, n, color); };
+      auto plot_edge = [=](int x, int y, int n)
+      { fill_span(pixels + (size_t)y * w + x, n, outline_color); };
+      if (t.filled)
+        fill_triangle(t.p0, t.p1, t.p2, t.z0, t.z1, t.z2, t.outline, clip, depth, plot, plot_edge);
+      else
+        draw_line(subpixel_to_pixel(t.p0), subpixel_to_pixel(t.p1), clip, [=](int x, int y)
+                  { pixels[(size_t)y * w + x] = color; });
+    }
+  }
+};
+
+#endif
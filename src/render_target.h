@@ -0,0 +1,182 @@
+#include <map>
+#include <string>
+#include "color.h"
+#include "ibehavior.h"
+#include "keycode.h"
+#include "text.h"
+#include "framebuffer.h"
+
+#ifndef RENDER_TARGET_H
+
+#define RENDER_TARGET_H
+
+/*
+  Where a Scene draws. It can be an actual window (see WindowTarget in window_target.h)
+  or an in-memory image, so that the scene can be rendered on a machine without display.
+
+  Pixel coordinates are window coordinates.
+*/
+class RenderTarget
+{
+public:
+  virtual ~RenderTarget() {}
+
+  // Makes the target ready to be drawn on. Returns false on failure.
+  virtual bool open() = 0;
+
+  // Frees the resources taken by open().
+  virtual void close() = 0;
+
+  // Registers the behaviors of user inputs. The target takes their ownership.
+  virtual void register_quit_behavior(minwin::IButtonBehavior *const behavior) = 0;
+  virtual void register_key_behavior(minwin::KeyCode key, minwin::IKeyBehavior *const behavior) = 0;
+
+  // Calls the behaviors of pending user inputs.
+  virtual void process_input() = 0;
+
+  // Fills up the whole target with the given color.
+  virtual void clear(const minwin::Color &color) = 0;
+
+  // Sets the color used by put_pixel().
+  virtual void set_draw_color(const minwin::Color &color) = 0;
+
+  // Draws one pixel with the current drawing color.
+  virtual void put_pixel(int x, int y) = 0;
+
+  // Copies a whole framebuffer with its top left corner at (x, y). Returns false if the
+  // target can't take framebuffers (then only put_pixel() draws on it).
+  virtual bool put_buffer(const FrameBuffer &fb, int x, int y) = 0;
+
+  virtual void render_text(const minwin::Text &text) = 0;
+
+  // Shows the elements drawn so far.
+  virtual void display() = 0;
+};
+
+/*
+  A render target kept in memory. Text is not rendered (there is no font). User inputs can
+  be simulated with press_key(), release_key() and click_quit().
+*/
+class MemoryTarget : public RenderTarget
+{
+  FrameBuffer pixels;
+  uint32_t draw_color;
+  minwin::IButtonBehavior *quit_behavior;
+  std::map<minwin::KeyCode, minwin::IKeyBehavior *> key_behaviors;
+
+public:
+  MemoryTarget(int width, int height) : pixels(width, height), draw_color(pack_color(minwin::WHITE)), quit_behavior(nullptr)
+  {
+  }
+
+  ~MemoryTarget()
+  {
+    unregister_behaviors();
+  }
+
+  // The pixels drawn so far.
+  const FrameBuffer &get_pixels() const
+  {
+    return pixels;
+  }
+
+  bool write_ppm(const std::string &file_name) const
+  {
+    return ::write_ppm(pixels, file_name);
+  }
+
+  bool write_png(const std::string &file_name) const
+  {
+    return ::write_png(pixels, file_name);
+  }
+
+  void press_key(minwin::KeyCode key)
+  {
+    auto it = key_behaviors.find(key);
+    if (it != key_behaviors.end())
+      it->second->on_press();
+  }
+
+  void release_key(minwin::KeyCode key)
+  {
+    auto it = key_behaviors.find(key);
+    if (it != key_behaviors.end())
+      it->second->on_release();
+  }
+
+  void click_quit()
+  {
+    if (quit_behavior != nullptr)
+      quit_behavior->on_click();
+  }
+
+  bool open()
+  {
+    return true;
+  }
+
+  void close()
+  {
+  }
+
+  void register_quit_behavior(minwin::IButtonBehavior *const behavior)
+  {
+    delete quit_behavior;
+    quit_behavior = behavior;
+  }
+
+  void register_key_behavior(minwin::KeyCode key, minwin::IKeyBehavior *const behavior)
+  {
+    auto it = key_behaviors.find(key);
+    if (it != key_behaviors.end())
+      delete it->second;
+    key_behaviors[key] = behavior;
+  }
+
+  void process_input()
+  {
+  }
+
+  void clear(const minwin::Color &color)
+  {
+    pixels.clear(pack_color(color));
+  }
+
+  void set_draw_color(const minwin::Color &color)
+  {
+    draw_color = pack_color(color);
+  }
+
+  void put_pixel(int x, int y)
+  {
+    pixels.put_pixel(x, y, draw_color);
+  }
+
+  bool put_buffer(const FrameBuffer &fb, int x, int y)
+  {
+    for (int j = 0; j < fb.get_height(); ++j)
+      for (int i = 0; i < fb.get_width(); ++i)
+        pixels.put_pixel(x + i, y + j, fb.get_pixel(i, j));
+    return true;
+  }
+
+  void render_text(const minwin::Text &)
+  {
+  }
+
+  void display()
+  {
+  }
+
+private:
+  void unregister_behaviors()
+  {
+    delete quit_behavior;
+    quit_behavior = nullptr;
+    for (auto &kb : key_behaviors)
+      delete kb.second;
+    key_behaviors.clear();
+  }
+};
+
+#endif
@@ -1,14 +1,29 @@
 #include "object.h"
+#include <algorithm>
+#include <cstdint>
 #include <string>
-#include "window.h"
+#include <thread>
 #include <assert.h>
 #include "camera.h"
+#include "clip.h"
+#include "framebuffer.h"
+#include "jobs.h"
+#include "raster.h"
+#include "render_target.h"
 
 #define CANVAS_DIM 700
 #define WINDOW_WIDTH 1366.0
 #define WINDOW_HEIGHT 768.0
 #define VIEWPORT_WIDTH 2.0
 #define VIEWPORT_HEIGHT (CANVAS_DIM / CANVAS_DIM * VIEWPORT_WIDTH)
+// distance from the camera to the viewport (projection plane)
+#define PROJECTION_DIST 50.0
+
+// number of vertices transformed by each job of the vertex stage
+#define VERTEX_GRAIN 4096
+
+// most frames between the geometry and raster stages (see Scene::run)
+#define MAX_FRAMES_IN_FLIGHT 4
 
 // X_DIFF and Y_DIFF are useful to center the drawing
 #define X_DIFF std::round((WINDOW_WIDTH - CANVAS_DIM) / 2)
@@ -16,21 +31,171 @@
 
 enum DrawMode
 {
-  wireframe,
-  solid
+  wireframe,  // the edges of the faces
+  solid,      // the faces filled, then their edges
+  solid_edges // the faces filled with their edges, in one pass (edges are hidden like faces)
+};
+
+// How the drawn pixels reach the window.
+enum PresentMode
+{
+  buffered, // draws into the framebuffer, uploaded as one texture per frame
+  per_pixel // one put_pixel call per drawn pixel (on the render target)
+};
+
+// How filled triangles are rasterized.
+enum FillMode
+{
+  edge_function, // tests the pixels of the bounding box against the edge equations
+  scanline       // interpolates the x bounds of each row (previous rasterizer)
+};
+
+// Counters about the last drawn frame.
+struct FrameStats
+{
+  uint matrix_builds;     // number of Camera/Object transform matrices (re)built
+  uint changed_objects;   // number of objects whose model-view-projection matrix changed
+  uint vertex_transforms; // number of vertices transformed and projected
+  uint culled_triangles;  // number of triangles skipped by the cull stage
+  uint culled_objects;    // number of objects outside of the view frustum
+  uint clipped_triangles; // number of faces cut by the near plane or the guard band
+  uint rejected_triangles; // number of faces entirely out of the view
+  uint drawn_lines;       // number of lines drawn by the wireframe and outline passes
+};
+
+// Vertices of an object after the vertex stage: x and y on the viewport and z the
+// reciprocal of their depth (see projection_matrix), with their outcodes (see ClipCode),
+// stored as a structure of arrays. The clip stage adds the vertices of the clipped faces
+// after those of the mesh.
+struct ProjectedVertices
+{
+  CoordArray x, y, z;
+  std::vector<uint8_t> clip;
+
+  void resize(size_t n)
+  {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    clip.resize(n);
+  }
+
+  // Adds a vertex, given in homogeneous clip coordinates (with w > 0), and returns its index.
+  uint32_t add(const aline::Vec4r &v)
+  {
+    x.push_back(v[0] / v[3]);
+    y.push_back(v[1] / v[3]);
+    z.push_back(v[2] / v[3]);
+    clip.push_back(0);
+    return x.size() - 1;
+  }
+
+  // The vertex i on the viewport.
+  inline aline::Vec2r get_point(size_t i) const
+  {
+    return aline::Vec2r({x[i], y[i]});
+  }
+};
+
+// A triangle to draw: the indices of its vertices (in ProjectedVertices) and the face of
+// the mesh it comes from.
+struct DrawTriangle
+{
+  uint32_t v0, v1, v2;
+  uint32_t face;
+};
+
+// Bounds of the objects in world coordinates (see Bounds), stored as a structure of
+// arrays for cull_bounds().
+struct WorldBounds
+{
+  CoordArray x, y, z, ex, ey, ez, r;
+
+  void resize(size_t n)
+  {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    ex.resize(n);
+    ey.resize(n);
+    ez.resize(n);
+    r.resize(n);
+  }
+
+  // Sets the bounds i to the bounds b transformed by the affine matrix m. The box is the
+  // one bounding the transformed box and the radius is scaled by the largest scale of m.
+  void set(size_t i, const aline::Mat44r &m, const Bounds &b)
+  {
+    aline::real *center[3] = {&x[i], &y[i], &z[i]};
+    aline::real *extent[3] = {&ex[i], &ey[i], &ez[i]};
+    aline::real scale = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+      *center[k] = m.at(k, 0) * b.center[0] + m.at(k, 1) * b.center[1] + m.at(k, 2) * b.center[2] + m.at(k, 3);
+      *extent[k] = fabs(m.at(k, 0)) * b.half_extents[0] + fabs(m.at(k, 1)) * b.half_extents[1] +
+                   fabs(m.at(k, 2)) * b.half_extents[2];
+      scale = std::max(scale, sqrt(m.at(0, k) * m.at(0, k) + m.at(1, k) * m.at(1, k) + m.at(2, k) * m.at(2, k)));
+    }
+    r[i] = b.radius * scale;
+  }
+};
+
+// A frame going through the pipeline of Scene::run: the settings and per-object matrices
+// it was submitted with, then the output of the geometry stage (the triangles and lines
+// queued for the tiled rasterizer). The scene has a few of them, so that the geometry
+// stage prepares a frame while the raster stage draws the previous one.
+struct FrameGeometry
+{
+  DrawMode draw_mode;
+  PresentMode present_mode;
+  FillMode fill_mode;
+  bool tiled; // whether the triangles go to the tiled rasterizer (otherwise they are drawn at once)
+  std::vector<aline::Mat44r> object_transforms; // model-view-projection matrix of each object
+  std::vector<size_t> changed_objects; // objects whose matrix changed since the previous frame
+  std::vector<uint8_t> object_visible; // whether each object may be in the view frustum
+  FrameStats stats;
+  std::vector<ScreenTriangle> screen_triangles; // triangles queued for the tiled rasterizer
 };
 
 class Scene
 {
   std::vector<Object> objects;
-  minwin::Window window;
+  RenderTarget *target;
   bool running;
-  minwin::Text text1, text2, text3, text4;
+  uint frame_count;
+  minwin::Text text1, text2, text3, text4, text5;
   DrawMode draw_mode;
+  PresentMode present_mode;
+  FillMode fill_mode;
+  JobSystem jobs; // threads of the vertex and cull stages and of the tiled rasterizer
   Camera camera;
+  FrameBuffer framebuffer;
+  DepthBuffer depth_buffer;
+  uint32_t draw_color;
+  aline::Mat44r projection;
+  aline::Mat44r view_projection;
+  Frustum view_frustum; // planes of view_projection, in world coordinates
+  WorldBounds world_bounds; // bounds of each object
+  std::vector<aline::Mat44r> object_transforms; // model-view-projection matrix of each object
+  std::vector<size_t> changed_objects; // objects whose model-view-projection matrix changed in the last frame
+  std::vector<ProjectedVertices> projected_vertices; // vertices of each object, projected on the viewport
+  std::vector<std::vector<DrawTriangle>> triangles; // triangles of each object left by the clip and cull stages
+  std::vector<uint8_t> edge_counts; // number of triangles of the object being drawn on each edge of its mesh (up to 2)
+  FrameStats stats; // of the last presented frame
+  TiledRasterizer tiled_rasterizer;
+  unsigned frames_in_flight; // frames submitted to the geometry stage and not presented yet, at most
+  FrameGeometry frames[MAX_FRAMES_IN_FLIGHT];
+  FrameGeometry *frame; // the frame prepared by the geometry stage
+  BoundedQueue<FrameGeometry *> geometry_queue; // frames submitted to the geometry thread
+  BoundedQueue<FrameGeometry *> ready_queue;    // frames prepared, waiting for the raster stage
+  std::thread geometry_thread;
 
 public:
-  Scene() : camera(Camera(1.0))
+  // The scene draws on the given target, which must outlive it.
+  Scene(RenderTarget *target) : target(target), jobs(1), camera(Camera(1.0)), framebuffer(CANVAS_DIM, CANVAS_DIM), depth_buffer(CANVAS_DIM, CANVAS_DIM),
+                                view_frustum(aline::Mat44r()),
+                                tiled_rasterizer(CANVAS_DIM, CANVAS_DIM), geometry_queue(MAX_FRAMES_IN_FLIGHT),
+                                ready_queue(MAX_FRAMES_IN_FLIGHT)
   {
     objects = std::vector<Object>();
     text1.set_pos(10, 10);
@@ -48,8 +213,32 @@ public:
     text4.set_pos(10, 70);
     text4.set_string("Use P O I K L M to rotate");
     text4.set_color(minwin::RED);
+
+    text5.set_pos(10, 90);
+    text5.set_string("Press B to change pixel path");
+    text5.set_color(minwin::RED);
     running = true;
+    frame_count = 0;
     draw_mode = wireframe;
+    present_mode = buffered;
+    fill_mode = edge_function;
+    draw_color = pack_color(minwin::WHITE);
+    projection = projection_matrix(PROJECTION_DIST);
+    stats = FrameStats();
+    frames_in_flight = 2;
+    frame = &frames[0];
+  }
+
+  Scene(const Scene &) = delete;
+  Scene &operator=(const Scene &) = delete;
+
+  ~Scene()
+  {
+    if (geometry_thread.joinable())
+    {
+      geometry_queue.push(nullptr);
+      geometry_thread.join();
+    }
   }
 
   DrawMode get_draw_mode()
@@ -65,6 +254,9 @@ public:
       draw_mode = solid;
       break;
     case solid:
+      draw_mode = solid_edges;
+      break;
+    case solid_edges:
       draw_mode = wireframe;
       break;
     default:
@@ -72,51 +264,132 @@ public:
     }
   }
 
+  void set_draw_mode(DrawMode mode)
+  {
+    draw_mode = mode;
+  }
+
+  PresentMode get_present_mode()
+  {
+    return present_mode;
+  }
+
+  void set_present_mode(PresentMode mode)
+  {
+    present_mode = mode;
+  }
+
+  void change_present_mode()
+  {
+    present_mode = present_mode == buffered ? per_pixel : buffered;
+  }
+
+  FillMode get_fill_mode()
+  {
+    return fill_mode;
+  }
+
+  void set_fill_mode(FillMode mode)
+  {
+    fill_mode = mode;
+  }
+
+  unsigned get_thread_count()
+  {
+    return jobs.get_thread_count();
+  }
+
+  // Sets the number of threads drawing the frames: they transform the vertices of large
+  // meshes, cull the triangles of the objects and, in buffered mode with the edge function
+  // rasterizer, rasterize the frames (the other modes draw in a single thread).
+  void set_thread_count(unsigned count)
+  {
+    jobs.set_thread_count(count);
+  }
+
+  unsigned get_max_frames_in_flight()
+  {
+    return frames_in_flight;
+  }
+
+  // Sets how many frames run() keeps between its two stages: with more than 1, a thread
+  // prepares the geometry of the next frames while the calling one rasterizes and
+  // presents the current one (in buffered mode with the edge function rasterizer; the
+  // other modes draw each frame at once). The frames are presented with as many frames of
+  // latency, minus one.
+  void set_max_frames_in_flight(unsigned count)
+  {
+    frames_in_flight = std::min(std::max(count, 1u), (unsigned)MAX_FRAMES_IN_FLIGHT);
+  }
+
+  // The number of frames drawn by run().
+  uint get_frame_count()
+  {
+    return frame_count;
+  }
+
+  // Counters about the last presented frame.
+  const FrameStats &get_stats()
+  {
+    return stats;
+  }
+
+  // The image drawn by the last frame (in buffered mode).
+  const FrameBuffer &get_framebuffer()
+  {
+    return framebuffer;
+  }
+
   // Adds a shape to the scene.
   void add_object(const Object &s)
   {
     objects.push_back(s);
   }
 
-  // Opens a MinWin window and sets its parameters (for instance, title and size).
+  size_t get_object_count()
+  {
+    return objects.size();
+  }
+
+  // The object i, which can be moved (the reference is invalidated by add_object()).
+  Object &get_object(size_t i)
+  {
+    return objects[i];
+  }
+
+  // The indices of the objects whose model-view-projection matrix changed in the last
+  // submitted frame, because they or the camera moved. The others kept their projected vertices.
+  const std::vector<size_t> &get_changed_objects()
+  {
+    return changed_objects;
+  }
+
+  // Registers the user inputs and opens the render target.
   void initialise()
   {
-    window = minwin::Window();
-    window.set_title("FMJ - Rasterizer");
-    window.set_width(WINDOW_WIDTH);
-    window.set_height(WINDOW_HEIGHT);
-    window.register_quit_behavior(new QuitButtonBehavior(*this));
-    window.register_key_behavior(minwin::KEY_ESCAPE, new QuitKeyBehavior(*this));
-    window.register_key_behavior(minwin::KEY_SPACE, new ChangeDrawModeBehavior(*this));
+    target->register_quit_behavior(new QuitButtonBehavior(*this));
+    target->register_key_behavior(minwin::KEY_ESCAPE, new QuitKeyBehavior(*this));
+    target->register_key_behavior(minwin::KEY_SPACE, new ChangeDrawModeBehavior(*this));
+    target->register_key_behavior(minwin::KEY_B, new ChangePresentModeBehavior(*this));
 
     // move keys
-    window.register_key_behavior(minwin::KEY_Z, new MoveUpYBehavior(camera));
-    window.register_key_behavior(minwin::KEY_S, new MoveDownYBehavior(camera));
-    window.register_key_behavior(minwin::KEY_Q, new MoveUpXBehavior(camera));
-    window.register_key_behavior(minwin::KEY_D, new MoveDownXBehavior(camera));
-    window.register_key_behavior(minwin::KEY_A, new MoveUpZBehavior(camera));
-    window.register_key_behavior(minwin::KEY_E, new MoveDownZBehavior(camera));
+    target->register_key_behavior(minwin::KEY_Z, new MoveUpYBehavior(camera));
+    target->register_key_behavior(minwin::KEY_S, new MoveDownYBehavior(camera));
+    target->register_key_behavior(minwin::KEY_Q, new MoveUpXBehavior(camera));
+    target->register_key_behavior(minwin::KEY_D, new MoveDownXBehavior(camera));
+    target->register_key_behavior(minwin::KEY_A, new MoveUpZBehavior(camera));
+    target->register_key_behavior(minwin::KEY_E, new MoveDownZBehavior(camera));
 
     // rotation keys
-    window.register_key_behavior(minwin::KEY_P, new RotateCwYBehavior(camera));
-    window.register_key_behavior(minwin::KEY_O, new RotateAcwYBehavior(camera));
-    window.register_key_behavior(minwin::KEY_I, new RotateCwXBehavior(camera));
-    window.register_key_behavior(minwin::KEY_K, new RotateAcwXBehavior(camera));
-    window.register_key_behavior(minwin::KEY_L, new RotateCwZBehavior(camera));
-    window.register_key_behavior(minwin::KEY_M, new RotateAcwZBehavior(camera));
-
-    // load font
-    if (not window.load_font("fonts/FreeMonoBold.ttf", 16u))
-    {
-      std::cerr << "Couldn't load font.\n";
-    }
-
-    // open window
-    if (not window.open())
-    {
-      std::cerr << "Couldn't open window.\n";
-      return;
-    }
+    target->register_key_behavior(minwin::KEY_P, new RotateCwYBehavior(camera));
+    target->register_key_behavior(minwin::KEY_O, new RotateAcwYBehavior(camera));
+    target->register_key_behavior(minwin::KEY_I, new RotateCwXBehavior(camera));
+    target->register_key_behavior(minwin::KEY_K, new RotateAcwXBehavior(camera));
+    target->register_key_behavior(minwin::KEY_L, new RotateCwZBehavior(camera));
+    target->register_key_behavior(minwin::KEY_M, new RotateAcwZBehavior(camera));
+
+    if (not target->open())
+      running = false;
   }
 
   /* Draws the objects previously added to the scene on the window surface1 and process
@@ -125,100 +398,485 @@ public:
   button ‘X’ or via some keyboard command (e.g., ‘ESC’ or ‘Q’). It must also permit
   the user to change the “view mode” of the scene. Via some keyboard command, the
   user can change from a “wireframe” mode of the scene to a “solid” and a “shaded”
-  (optional bonus feature) mode. */
-  void run()
+  (optional bonus feature) mode.
+  If max_frames is not 0, stops after max_frames frames (useful without display). */
+  void run(uint max_frames = 0)
   {
-    while (this->running)
+    frame_count = 0;
+    // The frames go through two stages: the geometry stage (vertex, clip and cull stages,
+    // and the triangles queued for the tiled rasterizer) and the raster stage (the tiles
+    // drawn, then presented). The inputs are processed and the per-object matrices built
+    // in this thread when a frame is submitted, while fewer than frames_in_flight frames
+    // are between the stages.
+    size_t submitted = 0, presented = 0;
+    while (true)
     {
-      // process keyboard inputs, etc.
-      window.process_input();
+      bool more = this->running && (max_frames == 0 || submitted < max_frames);
+      if (more && submitted - presented < frames_in_flight)
+      {
+        FrameGeometry &next = frames[submitted % frames_in_flight];
+        submit_frame(next);
+        ++submitted;
+        if (next.tiled && frames_in_flight > 1)
+        {
+          if (!geometry_thread.joinable())
+            geometry_thread = std::thread(&Scene::geometry_loop, this);
+          geometry_queue.push(&next);
+          continue;
+        }
+        // the frame draws directly on the framebuffer or the target: the previous ones are
+        // presented first, then it is drawn in this thread
+        while (presented + 1 < submitted)
+        {
+          present_frame(*ready_queue.pop(), false);
+          ++presented;
+        }
+        present_frame(next, true);
+        ++presented;
+        continue;
+      }
+      if (presented == submitted)
+        break;
+      present_frame(*ready_queue.pop(), false);
+      ++presented;
+    }
+    target->close();
+  }
 
-      camera.update();
+private:
+  /*Closes the MinWin window and frees eventual allocated memory. (For example, if
+  your function add_shape() creates a list of objects, you must clear the list.)*/
+  void shutdown()
+  {
+    this->running = false;
+  }
 
-      // clear window
-      window.clear();
+  // Processes the inputs and prepares the next frame for the geometry stage, with the
+  // current settings.
+  void submit_frame(FrameGeometry &next)
+  {
+    // process keyboard inputs, etc.
+    target->process_input();
+    camera.update();
+
+    next.draw_mode = draw_mode;
+    next.present_mode = present_mode;
+    next.fill_mode = fill_mode;
+    // in buffered mode, the edge function rasterizer can draw the triangles by tiles,
+    // in parallel, once they are all known
+    next.tiled = present_mode == buffered && fill_mode == edge_function;
+    next.stats = FrameStats();
+    transform_stage(next);
+    frustum_stage(next);
+  }
 
-      // draw text
-      window.render_text(text1);
-      window.render_text(text2);
-      window.render_text(text3);
-      window.render_text(text4);
+  // Builds, once per frame, the model-view-projection matrix of the objects which moved
+  // (of every object if the camera moved) and lists them in changed_objects. Matrices of
+  // static objects are kept from the previous frames. They are copied into the frame, as
+  // the geometry stage may still be working on the previous ones.
+  void transform_stage(FrameGeometry &next)
+  {
+    bool camera_moved = camera.is_dirty();
+    if (camera_moved)
+    {
+      view_projection = projection * camera.transform();
+      view_frustum = Frustum(view_projection);
+      ++next.stats.matrix_builds;
+    }
 
-      for (Object o : objects)
+    size_t known_objects = object_transforms.size();
+    object_transforms.resize(objects.size());
+    world_bounds.resize(objects.size());
+    changed_objects.clear();
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+      const Object &o = objects[i];
+      bool moved = o.is_dirty() || i >= known_objects;
+      if (o.is_dirty())
+        ++next.stats.matrix_builds;
+      if (moved)
+        world_bounds.set(i, o.transform(), o.get_shape().get_bounds());
+      if (camera_moved || moved)
       {
-        std::vector<Face> faces = o.get_faces();
-        std::vector<Vertex> verts = o.get_vertices();
+        object_transforms[i] = view_projection * o.transform();
+        changed_objects.push_back(i);
+      }
+    }
+    next.stats.changed_objects = changed_objects.size();
+    next.object_transforms = object_transforms;
+    next.changed_objects = changed_objects;
+  }
 
-        switch (draw_mode)
-        {
-          case wireframe:
-            // draw only vertices
-            for (Face f : faces)
-            {
-              // make homogeneous coordinates and perspective projection
-              aline::Vec3r _v0 = verts[f.get_v0()].get_vec();
-              aline::Vec3r _v1 = verts[f.get_v1()].get_vec();
-              aline::Vec3r _v2 = verts[f.get_v2()].get_vec();
-
-              aline::Vec2r v0 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v0[0], _v0[1], _v0[2], 1.0}), 50.0);
-              aline::Vec2r v1 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v1[0], _v1[1], _v1[2], 1.0}), 50.0);
-              aline::Vec2r v2 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v2[0], _v2[1], _v2[2], 1.0}), 50.0);
-
-              // draw wireframe triangle
-              window.set_draw_color(minwin::WHITE);
-              draw_wireframe_triangle(v0, v1, v2);
-            }
-            break;
-          case solid:
-            // draw filled triangles then their outline
-            for (Face f : faces)
-            {
-              // make homogeneous coordinates and perspective projection
-              aline::Vec3r _v0 = verts[f.get_v0()].get_vec();
-              aline::Vec3r _v1 = verts[f.get_v1()].get_vec();
-              aline::Vec3r _v2 = verts[f.get_v2()].get_vec();
-    
-              aline::Vec2r v0 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v0[0], _v0[1], _v0[2], 1.0}), 50.0);
-              aline::Vec2r v1 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v1[0], _v1[1], _v1[2], 1.0}), 50.0);
-              aline::Vec2r v2 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v2[0], _v2[1], _v2[2], 1.0}), 50.0);
-
-              // draw faces filling
-              window.set_draw_color(f.get_color());
-              draw_filled_triangle(v0, v1, v2);
-            }
-            for (Face f : faces)
-            {
-              // make homogeneous coordinates and perspective projection
-              aline::Vec3r _v0 = verts[f.get_v0()].get_vec();
-              aline::Vec3r _v1 = verts[f.get_v1()].get_vec();
-              aline::Vec3r _v2 = verts[f.get_v2()].get_vec();
-    
-              aline::Vec2r v0 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v0[0], _v0[1], _v0[2], 1.0}), 50.0);
-              aline::Vec2r v1 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v1[0], _v1[1], _v1[2], 1.0}), 50.0);
-              aline::Vec2r v2 = perspective_projection(camera.transform()*o.transform()*aline::Vec4r({_v2[0], _v2[1], _v2[2], 1.0}), 50.0);
-
-              // draw faces outline
-              window.set_draw_color(minwin::BLACK);
-              draw_wireframe_triangle(v0, v1, v2);
-            }
-            break;
-          default:
+  // The loop of the geometry thread: prepares the submitted frames, in order, until it
+  // gets a null one.
+  void geometry_loop()
+  {
+    for (FrameGeometry *f = geometry_queue.pop(); f != nullptr; f = geometry_queue.pop())
+    {
+      frame = f;
+      geometry_stage();
+      ready_queue.push(f);
+    }
+  }
+
+  // Prepares the frame: its triangles are queued for the tiled rasterizer, or drawn at
+  // once.
+  void geometry_stage()
+  {
+    vertex_stage();
+    clip_stage();
+    cull_stage();
+
+    frame->screen_triangles.clear();
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+      const Object &o = objects[i];
+      const ProjectedVertices &verts = projected_vertices[i];
+      const std::vector<minwin::Color> &colors = o.get_mesh().get_colors();
+
+      switch (frame->draw_mode)
+      {
+        case wireframe:
+          // draw only edges
+          set_draw_color(minwin::WHITE);
+          draw_edges(i);
+          break;
+        case solid_edges:
+          // the scanline rasterizer has no depth, so the edges are drawn after the faces
+          // as in solid mode
+          if (frame->fill_mode == edge_function)
+          {
+            draw_outlined_triangles(i);
             break;
+          }
+          // fall through
+        case solid:
+          // draw filled triangles (hiding each other) then their outline
+          for (const DrawTriangle &t : triangles[i])
+          {
+            // draw faces filling
+            set_draw_color(colors[t.face]);
+            draw_filled_triangle(verts.get_point(t.v0), verts.get_point(t.v1), verts.get_point(t.v2),
+                                 verts.z[t.v0], verts.z[t.v1], verts.z[t.v2]);
+          }
+          set_draw_color(minwin::BLACK);
+          draw_edges(i);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  // Clears the frame, draws it (with the geometry stage, if it was not prepared) and
+  // presents it.
+  void present_frame(FrameGeometry &f, bool draw_geometry)
+  {
+    // clear window
+    target->clear(minwin::BLACK);
+    if (f.present_mode == buffered)
+      framebuffer.clear(pack_color(minwin::BLACK));
+    if (f.draw_mode != wireframe)
+      depth_buffer.clear();
+
+    // draw text
+    target->render_text(text1);
+    target->render_text(text2);
+    target->render_text(text3);
+    target->render_text(text4);
+    target->render_text(text5);
+
+    if (draw_geometry)
+    {
+      frame = &f;
+      geometry_stage();
+    }
+    if (f.tiled)
+      raster_stage(f);
+
+    // send the framebuffer, then display elements drawn so far
+    // (if the target can't take it, the next frames are drawn pixel by pixel)
+    if (f.present_mode == buffered && !target->put_buffer(framebuffer, X_DIFF, Y_DIFF))
+      present_mode = per_pixel;
+    target->display();
+    stats = f.stats;
+    ++frame_count;
+  }
+
+  // Draws the triangles queued by the geometry stage, by tiles.
+  void raster_stage(const FrameGeometry &f)
+  {
+    tiled_rasterizer.bin(f.screen_triangles);
+    tiled_rasterizer.draw(f.screen_triangles, framebuffer, depth_buffer, jobs);
+  }
+
+  // Tests, once per frame, the bounds of all the objects against the view frustum (in one
+  // batch). The objects outside of it are neither transformed nor drawn: their projected
+  // vertices are only updated once they move back in, which needs them or the camera to
+  // move, so that they are in changed_objects again.
+  void frustum_stage(FrameGeometry &next)
+  {
+    aline::real planes[6][4];
+    view_frustum.get_planes(planes);
+    next.object_visible.resize(objects.size());
+    aline::cull_bounds(planes, world_bounds.x.data(), world_bounds.y.data(), world_bounds.z.data(),
+                       world_bounds.ex.data(), world_bounds.ey.data(), world_bounds.ez.data(),
+                       world_bounds.r.data(), objects.size(), next.object_visible.data());
+    next.stats.culled_objects = std::count(next.object_visible.begin(), next.object_visible.end(), 0);
+  }
+
+  // Transforms and projects, once per frame, the vertices of the changed objects (in the
+  // view frustum).
+  void vertex_stage()
+  {
+    projected_vertices.resize(objects.size());
+    for (size_t i : frame->changed_objects)
+    {
+      if (!frame->object_visible[i])
+        continue;
+      const Mesh &mesh = objects[i].get_mesh();
+      ProjectedVertices &projected = projected_vertices[i];
+      projected.resize(mesh.vertex_count());
+      // large meshes are split in ranges of vertices transformed by the job threads
+      const aline::Mat44r &m = frame->object_transforms[i];
+      jobs.parallel_for(0, mesh.vertex_count(), VERTEX_GRAIN, [&](size_t begin, size_t end)
+                        {
+                          aline::transform_points(m, mesh.get_x().data() + begin, mesh.get_y().data() + begin,
+                                                  mesh.get_z().data() + begin, end - begin, projected.x.data() + begin,
+                                                  projected.y.data() + begin, projected.z.data() + begin);
+                          for (size_t v = begin; v < end; ++v)
+                            projected.clip[v] = clip_outcode(projected.x[v], projected.y[v], projected.z[v]);
+                        });
+      frame->stats.vertex_transforms += mesh.vertex_count();
+    }
+  }
+
+  // Lists, once per frame, the triangles of each visible object. Faces entirely out of the
+  // view are rejected. Faces across the near plane (whose projection is meaningless) or
+  // out of the guard band (which could be arbitrarily large) are clipped in homogeneous
+  // coordinates, recomputed from the mesh, and replaced by a fan of triangles. The others
+  // are kept as they are: the rasterizer skips their pixels out of the canvas.
+  void clip_stage()
+  {
+    triangles.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+      std::vector<DrawTriangle> &tris = triangles[i];
+      tris.clear();
+      if (!frame->object_visible[i])
+        continue;
+      const Mesh &mesh = objects[i].get_mesh();
+      const uint32_t *indices = mesh.get_indices().data();
+      ProjectedVertices &verts = projected_vertices[i];
+      // remove the vertices added by the previous frame
+      verts.resize(mesh.vertex_count());
+      for (uint32_t f = 0; f < mesh.face_count(); ++f)
+      {
+        uint32_t i0 = indices[3 * f], i1 = indices[3 * f + 1], i2 = indices[3 * f + 2];
+        uint8_t c0 = verts.clip[i0], c1 = verts.clip[i1], c2 = verts.clip[i2];
+        if (c0 & c1 & c2 & ~clip_guard)
+        {
+          ++frame->stats.rejected_triangles;
+          continue;
+        }
+        if (((c0 | c1 | c2) & (clip_near | clip_guard)) == 0)
+        {
+          tris.push_back(DrawTriangle{i0, i1, i2, f});
+          continue;
+        }
+
+        const aline::Mat44r &m = frame->object_transforms[i];
+        aline::Vec4r face[3], polygon[CLIP_MAX_VERTICES];
+        uint32_t face_indices[3] = {i0, i1, i2};
+        for (int k = 0; k < 3; ++k)
+        {
+          aline::Vec3r v = mesh.get_vertex(face_indices[k]);
+          face[k] = m * aline::Vec4r({v[0], v[1], v[2], 1.0});
+        }
+        int n = clip_triangle(face, polygon);
+        ++frame->stats.clipped_triangles;
+        if (n < 3)
+          continue;
+        uint32_t first = verts.add(polygon[0]), previous = verts.add(polygon[1]);
+        for (int k = 2; k < n; ++k)
+        {
+          uint32_t next = verts.add(polygon[k]);
+          tris.push_back(DrawTriangle{first, previous, next, f});
+          previous = next;
         }
       }
+    }
+  }
+
+  // Removes, once per frame, the triangles left out by the cull mode of their object,
+  // according to their winding on the viewport: the camera space is left-handed (y up,
+  // z forward), so front faces appear clockwise. Degenerate (zero area) triangles are
+  // culled too. The objects are shared among the job threads.
+  void cull_stage()
+  {
+    std::atomic<size_t> culled(0);
+    jobs.parallel_for(0, objects.size(), 1, [&](size_t begin, size_t end)
+                      {
+                        for (size_t i = begin; i < end; ++i)
+                          culled += cull_triangles(i);
+                      });
+    frame->stats.culled_triangles += culled;
+  }
 
-      // display elements drawn so far
-      window.display();
+  // Culls the triangles of the object i and returns their number.
+  size_t cull_triangles(size_t i)
+  {
+    CullMode mode = objects[i].get_cull_mode();
+    if (mode == cull_none)
+      return 0;
+    const aline::real *x = projected_vertices[i].x.data();
+    const aline::real *y = projected_vertices[i].y.data();
+    std::vector<DrawTriangle> &tris = triangles[i];
+    size_t kept = 0;
+    for (const DrawTriangle &t : tris)
+    {
+      // twice the signed area, positive if counter-clockwise
+      aline::real area = (x[t.v1] - x[t.v0]) * (y[t.v2] - y[t.v0]) - (x[t.v2] - x[t.v0]) * (y[t.v1] - y[t.v0]);
+      if (mode == cull_back ? area < 0 : area > 0)
+        tris[kept++] = t;
     }
-    window.close();
+    size_t culled = tris.size() - kept;
+    tris.resize(kept);
+    return culled;
   }
 
-private:
-  /*Closes the MinWin window and frees eventual allocated memory. (For example, if
-  your function add_shape() creates a list of objects, you must clear the list.)*/
-  void shutdown()
+  // Counts, in edge_counts, the triangles of the object i left by the clip and cull stages
+  // on each edge of its mesh (see Shape::get_edges), up to 2. The triangles of clipped
+  // faces have their own vertices: they are not counted.
+  void count_edges(size_t i)
   {
-    this->running = false;
+    const Shape &shape = objects[i].get_shape();
+    const uint32_t *face_edges = shape.get_face_edges().data();
+    size_t vertex_count = shape.get_mesh().vertex_count();
+    edge_counts.assign(shape.edge_count(), 0);
+    for (const DrawTriangle &t : triangles[i])
+      if (t.v0 < vertex_count)
+        for (int k = 0; k < 3; ++k)
+        {
+          uint8_t &count = edge_counts[face_edges[3 * t.face + k]];
+          count = std::min(count + 1, 2);
+        }
+  }
+
+  // The sides of the triangle j of a clipped face which are on the polygon (see
+  // OutlineBits). The triangles of the fan are (first, previous, next): the side 1 always
+  // is, the side 0 of the first triangle and the side 2 of the last one too.
+  static int polygon_sides(const std::vector<DrawTriangle> &tris, size_t j)
+  {
+    const DrawTriangle &t = tris[j];
+    int sides = outline_side1;
+    if (t.v1 == t.v0 + 1)
+      sides |= outline_side0;
+    if (j + 1 == tris.size() || tris[j + 1].v0 != t.v0)
+      sides |= outline_side2;
+    return sides;
+  }
+
+  // Draws the edges of the triangles of the object i, with the current drawing color. The
+  // edges of the mesh are shared by its faces, so those of the triangles left are counted
+  // first, then each one is drawn once. Clipped faces are outlined by the sides of their
+  // polygon, not the inner sides of their fan.
+  void draw_edges(size_t i)
+  {
+    const ProjectedVertices &verts = projected_vertices[i];
+    size_t vertex_count = objects[i].get_mesh().vertex_count();
+    const std::vector<DrawTriangle> &tris = triangles[i];
+    count_edges(i);
+    for (size_t j = 0; j < tris.size(); ++j)
+    {
+      const DrawTriangle &t = tris[j];
+      if (t.v0 < vertex_count)
+        continue;
+      uint32_t v[3] = {t.v0, t.v1, t.v2};
+      int sides = polygon_sides(tris, j);
+      for (int k = 0; k < 3; ++k)
+        if (sides >> k & 1)
+          draw_line(verts.get_point(v[k]), verts.get_point(v[(k + 1) % 3]));
+    }
+
+    const uint32_t *edges = objects[i].get_shape().get_edges().data();
+    for (size_t e = 0; e < edge_counts.size(); ++e)
+      if (edge_counts[e])
+        draw_line(verts.get_point(edges[2 * e]), verts.get_point(edges[2 * e + 1]));
+  }
+
+  // Fills the triangles of the object i with their edges in black, in one pass: the
+  // rasterizer draws the pixels next to the outlined sides in black (see fill_triangle).
+  // The sides of a triangle are the edges of its face, those shared by two triangles being
+  // outlined by one of them. A clipped face is a fan of triangles, whose inner sides are
+  // not outlined.
+  void draw_outlined_triangles(size_t i)
+  {
+    const Shape &shape = objects[i].get_shape();
+    const uint32_t *face_edges = shape.get_face_edges().data();
+    const std::vector<minwin::Color> &colors = shape.get_mesh().get_colors();
+    size_t vertex_count = shape.get_mesh().vertex_count();
+    const ProjectedVertices &verts = projected_vertices[i];
+    const std::vector<DrawTriangle> &tris = triangles[i];
+    count_edges(i);
+    for (size_t j = 0; j < tris.size(); ++j)
+    {
+      const DrawTriangle &t = tris[j];
+      int outline = outline_sides;
+      if (t.v0 < vertex_count)
+      {
+        for (int k = 0; k < 3; ++k)
+          if (edge_counts[face_edges[3 * t.face + k]] > 1)
+            outline |= outline_shared0 << k;
+      }
+      else
+        outline = polygon_sides(tris, j);
+      set_draw_color(colors[t.face]);
+      draw_filled_triangle(verts.get_point(t.v0), verts.get_point(t.v1), verts.get_point(t.v2),
+                           verts.z[t.v0], verts.z[t.v1], verts.z[t.v2], outline);
+    }
+  }
+
+  // Sets the color of the next drawn pixels.
+  void set_draw_color(const minwin::Color &color)
+  {
+    draw_color = pack_color(color);
+    // (the target is only drawn on in this thread without the tiled rasterizer)
+    if (frame->present_mode == per_pixel)
+      target->set_draw_color(color);
+  }
+
+  // Draws one pixel (canvas coordinates) with the current drawing color.
+  inline void put_pixel(int x, int y)
+  {
+    if (frame->present_mode == buffered)
+      framebuffer.put_pixel(x, y, draw_color);
+    else
+      target->put_pixel(x + X_DIFF, y + Y_DIFF);
+  }
+
+  // Draws n pixels of a row from (x, y) (canvas coordinates) with the current drawing color.
+  inline void put_span(int x, int y, int n)
+  {
+    if (frame->present_mode == buffered)
+      framebuffer.fill_span(x, y, n, draw_color);
+    else
+      for (int i = 0; i < n; ++i)
+        target->put_pixel(x + i + X_DIFF, y + Y_DIFF);
+  }
+
+  // Draws n pixels of an outline from (x, y) (canvas coordinates), in black.
+  inline void put_outline_span(int x, int y, int n)
+  {
+    if (frame->present_mode == buffered)
+      framebuffer.fill_span(x, y, n, pack_color(minwin::BLACK));
+    else
+    {
+      target->set_draw_color(minwin::BLACK);
+      for (int i = 0; i < n; ++i)
+        target->put_pixel(x + i + X_DIFF, y + Y_DIFF);
+      target->set_draw_color(unpack_color(draw_color));
+    }
   }
 
   // Converts viewport coordinates of a point to canvas coordinates.
@@ -230,58 +888,79 @@ private:
     return aline::Vec2r({point[0] * CANVAS_DIM / VIEWPORT_WIDTH, point[1] * CANVAS_DIM / VIEWPORT_HEIGHT});
   }
 
-  // Converts canvas coordinates of a point to window (screen) coordinates.
+  // Converts canvas coordinates of a point to window (screen) coordinates, in fixed point
+  // with RASTER_SUBPIXEL_BITS fractional bits.
+  aline::Vec2i canvas_to_subpixel(const aline::Vec2r &point) const
+  {
+    return aline::Vec2i({(int)std::round((CANVAS_DIM / 2 + point[0]) * RASTER_SUBPIXEL),
+                         (int)std::round((CANVAS_DIM / 2 - point[1]) * RASTER_SUBPIXEL)});
+  }
+
+  // Converts canvas coordinates of a point to window (screen) coordinates: the pixel
+  // containing it.
   aline::Vec2i canvas_to_window(const aline::Vec2r &point) const
   {
-    return aline::Vec2i({(int)std::round(CANVAS_DIM / 2 + point[0]), (int)std::round(CANVAS_DIM / 2 - point[1])});
+    return subpixel_to_pixel(canvas_to_subpixel(point));
   }
 
-  // Draws a line from v0 to v1 using the current drawing color.
+  // Draws a line from v0 to v1 using the current drawing color, clipped to the canvas.
   // I use Bresenham's algorithm (Wikipedia)
-  void draw_line(const aline::Vec2r &v0, const aline::Vec2r &v1) const
+  void draw_line(const aline::Vec2r &v0, const aline::Vec2r &v1)
   {
-    aline::Vec2i _v0 = canvas_to_window(viewport_to_canvas(v0));
-    aline::Vec2i _v1 = canvas_to_window(viewport_to_canvas(v1));
-
-    int x0 = _v0[0], y0 = _v0[1];
-    int x1 = _v1[0], y1 = _v1[1];
-    int dx = abs(x1 - x0);
-    int sx = x0 < x1 ? 1 : -1;
-    int dy = -abs(y1 - y0);
-    int sy = y0 < y1 ? 1 : -1;
-    int error = dx + dy;
+    ++frame->stats.drawn_lines;
+    if (frame->tiled)
+    {
+      queue_line(v0, v1);
+      return;
+    }
+    PixelRect canvas{0, 0, CANVAS_DIM - 1, CANVAS_DIM - 1};
+    ::draw_line(canvas_to_window(viewport_to_canvas(v0)), canvas_to_window(viewport_to_canvas(v1)), canvas,
+                [this](int x, int y)
+                { put_pixel(x, y); });
+  }
 
-    while (true)
+  // Fills a triangle, hidden by the nearer ones (z0, z1 and z2 are the reciprocal depths
+  // of its vertices), with the given sides outlined in black (see OutlineBits). The
+  // scanline rasterizer ignores the depth and the outline.
+  void draw_filled_triangle(const aline::Vec2r &v0, const aline::Vec2r &v1, const aline::Vec2r &v2,
+                            aline::real z0, aline::real z1, aline::real z2, int outline = 0)
+  {
+    if (frame->tiled)
+      queue_triangle(v0, v1, v2, z0, z1, z2, outline);
+    else if (frame->fill_mode == scanline)
+      draw_filled_triangle_scanline(v0, v1, v2);
+    else
     {
-      window.put_pixel(x0 + X_DIFF, y0 + Y_DIFF);
-      if (x0 == x1 && y0 == y1)
-        break;
-      int e2 = 2 * error;
-      if (e2 >= dy)
-      {
-        if (x0 == x1)
-          break;
-        error = error + dy;
-        x0 = x0 + sx;
-      }
-      if (e2 <= dx)
-      {
-        if (y0 == y1)
-          break;
-        error = error + dx;
-        y0 = y0 + sy;
-      }
+      PixelRect canvas{0, 0, CANVAS_DIM - 1, CANVAS_DIM - 1};
+      fill_triangle(canvas_to_subpixel(viewport_to_canvas(v0)), canvas_to_subpixel(viewport_to_canvas(v1)),
+                    canvas_to_subpixel(viewport_to_canvas(v2)), z0, z1, z2, outline, canvas, depth_buffer,
+                    [this](int x, int y, int n)
+                    { put_span(x, y, n); },
+                    [this](int x, int y, int n)
+                    { put_outline_span(x, y, n); });
     }
   }
 
-  void draw_wireframe_triangle(const aline::Vec2r &v0, const aline::Vec2r &v1, const aline::Vec2r &v2) const
+  // Adds a filled triangle, with the current drawing color, to those drawn by raster_stage().
+  void queue_triangle(const aline::Vec2r &v0, const aline::Vec2r &v1, const aline::Vec2r &v2,
+                      aline::real z0, aline::real z1, aline::real z2, int outline)
+  {
+    frame->screen_triangles.push_back(ScreenTriangle{canvas_to_subpixel(viewport_to_canvas(v0)),
+                                              canvas_to_subpixel(viewport_to_canvas(v1)),
+                                              canvas_to_subpixel(viewport_to_canvas(v2)),
+                                              (float)z0, (float)z1, (float)z2, draw_color, true,
+                                              (uint8_t)outline, pack_color(minwin::BLACK)});
+  }
+
+  // Adds a line, with the current drawing color, to those drawn by raster_stage().
+  void queue_line(const aline::Vec2r &v0, const aline::Vec2r &v1)
   {
-    draw_line(v0, v1);
-    draw_line(v1, v2);
-    draw_line(v2, v0);
+    aline::Vec2i p0 = canvas_to_subpixel(viewport_to_canvas(v0)), p1 = canvas_to_subpixel(viewport_to_canvas(v1));
+    frame->screen_triangles.push_back(ScreenTriangle{p0, p1, p1, 0, 0, 0, draw_color, false, 0, 0});
   }
 
-  void draw_filled_triangle(const aline::Vec2r &v0, const aline::Vec2r &v1, const aline::Vec2r &v2) const
+  // Fills a triangle row by row, between the x bounds interpolated along its edges.
+  void draw_filled_triangle_scanline(const aline::Vec2r &v0, const aline::Vec2r &v1, const aline::Vec2r &v2)
   {
     aline::Vec2i _v0 = canvas_to_window(viewport_to_canvas(v0));
     aline::Vec2i _v1 = canvas_to_window(viewport_to_canvas(v1));
@@ -321,7 +1000,7 @@ private:
 
     for (int y = y0; y <= y2; ++y)
       for (int x = (int)std::round(x_left[y - y0]); x <= (int)std::round(x_right[y - y0]); ++x)
-        window.put_pixel(x + X_DIFF, y + Y_DIFF);
+        put_pixel(x, y);
   }
 
   std::vector<aline::real> interpolate(int i0, aline::real d0, int i1, aline::real d1) const
@@ -340,16 +1019,19 @@ private:
     return values;
   }
 
-  // The perspective projection of the three dimentional vector v given in homogeneous
-  // coordinates. The value of d is the distance from the camera to the viewport (also
-  // called projection plane)
-  aline::Vec2r perspective_projection(const aline::Vec4r &v, aline::real d)
+  // The projection matrix. Multiplied by a point given in camera coordinates, it gives
+  // homogeneous coordinates whose perspective divide is the projection of the point on
+  // the viewport, with z the reciprocal of the depth of the point (1/z, which varies
+  // linearly on the viewport, see DepthBuffer). The value of d is the distance from the
+  // camera to the viewport (also called projection plane)
+  aline::Mat44r projection_matrix(aline::real d) const
   {
-    // project in 2d
-    if(v[2] == 0)
-      return aline::Vec2r({0.0, 0.0});
-    else
-      return aline::Vec2r({(d*v[0])/v[2], (d*v[1])/v[2]});
+    return aline::Mat44r({
+      {d, 0.0, 0.0, 0.0},
+      {0.0, d, 0.0, 0.0},
+      {0.0, 0.0, 0.0, 1.0},
+      {0.0, 0.0, 1.0, 0.0}
+    });
   }
 
   class QuitKeyBehavior : public minwin::IKeyBehavior
@@ -393,6 +1075,20 @@ private:
     Scene &owner;
   };
 
+  class ChangePresentModeBehavior : public minwin::IKeyBehavior
+  {
+  public:
+    ChangePresentModeBehavior(Scene &s) : owner{s} {}
+    void on_press() const {};
+    void on_release() const
+    {
+      this->owner.change_present_mode();
+    }
+
+  private:
+    Scene &owner;
+  };
+
   class MoveUpYBehavior : public minwin::IKeyBehavior
   {
   public:
@@ -3,6 +3,7 @@
 #include <cmath>
 #include <sstream>
 #include <float.h>
+#include <type_traits>
 
 #ifndef VECTOR_H
 
@@ -10,8 +11,44 @@
 
 namespace aline
 {
+  /*
+    Expression templates. The operators on vectors do not compute anything: they return
+    small expression objects (sums, products...) holding their operands. The elements are
+    computed when the expression is stored in a Vector (or read by a function such as
+    dot()), in one loop and without intermediate vectors. Thus a*b + c*s is a single loop.
+
+    E is the actual expression type, T the type of its elements and N its size.
+  */
+  template <class E, class T, int N>
+  class VectorExpr
+  {
+  public:
+    // The element i of the expression.
+    inline T operator[](size_t i) const
+    {
+      return static_cast<const E &>(*this)[i];
+    }
+  };
+
   template <class T, int N>
-  class Vector
+  class Vector;
+
+  // How an expression holds its operands: vectors by reference (they outlive the
+  // full-expression), expressions by value (they are temporaries).
+  template <class E>
+  struct ExprOperand
+  {
+    using type = const E;
+  };
+
+  template <class T, int N>
+  struct ExprOperand<Vector<T, N>>
+  {
+    using type = const Vector<T, N> &;
+  };
+
+  template <class T, int N>
+  class Vector : public VectorExpr<Vector<T, N>, T, N>
   {
     T elmts[N];
 
@@ -50,6 +87,39 @@ namespace aline
       }
     }
 
+    // Evaluates an expression (one loop, no intermediate vector).
+    template <class E>
+    Vector(const VectorExpr<E, T, N> &e)
+    {
+      const E &expr = static_cast<const E &>(e);
+      for (int i = 0; i < N; i++)
+      {
+        elmts[i] = expr[i];
+      }
+    }
+
+    Vector<T, N> &operator=(const Vector<T, N> &v)
+    {
+      for (int i = 0; i < N; i++)
+      {
+        elmts[i] = v.elmts[i];
+      }
+      return *this;
+    }
+
+    // Evaluates an expression into this vector. The expressions are element-wise, so the
+    // vector may appear in the expression.
+    template <class E>
+    Vector<T, N> &operator=(const VectorExpr<E, T, N> &e)
+    {
+      const E &expr = static_cast<const E &>(e);
+      for (int i = 0; i < N; i++)
+      {
+        elmts[i] = expr[i];
+      }
+      return *this;
+    }
+
     T at(size_t i) const
     {
       if (i >= N)
@@ -68,8 +138,10 @@ namespace aline
       return elmts[i];
     }
 
-    Vector<T, N> &operator+=(const Vector<T, N> &v)
+    template <class E>
+    Vector<T, N> &operator+=(const VectorExpr<E, T, N> &e)
     {
+      const E &v = static_cast<const E &>(e);
       for (size_t i = 0; i < N; i++)
       {
         elmts[i] = elmts[i] + v[i];
@@ -79,10 +151,59 @@ namespace aline
     }
   };
 
+  // Expression of the sum of two vectors.
+  template <class E1, class E2, class T, int N>
+  class VectorSum : public VectorExpr<VectorSum<E1, E2, T, N>, T, N>
+  {
+    typename ExprOperand<E1>::type u;
+    typename ExprOperand<E2>::type v;
+
+  public:
+    VectorSum(const E1 &u, const E2 &v) : u(u), v(v) {}
+    inline T operator[](size_t i) const { return u[i] + v[i]; }
+  };
+
+  // Expression of the difference of two vectors.
+  template <class E1, class E2, class T, int N>
+  class VectorDifference : public VectorExpr<VectorDifference<E1, E2, T, N>, T, N>
+  {
+    typename ExprOperand<E1>::type u;
+    typename ExprOperand<E2>::type v;
+
+  public:
+    VectorDifference(const E1 &u, const E2 &v) : u(u), v(v) {}
+    inline T operator[](size_t i) const { return u[i] - v[i]; }
+  };
+
+  // Expression of the element-wise product of two vectors.
+  template <class E1, class E2, class T, int N>
+  class VectorProduct : public VectorExpr<VectorProduct<E1, E2, T, N>, T, N>
+  {
+    typename ExprOperand<E1>::type u;
+    typename ExprOperand<E2>::type v;
+
+  public:
+    VectorProduct(const E1 &u, const E2 &v) : u(u), v(v) {}
+    inline T operator[](size_t i) const { return u[i] * v[i]; }
+  };
+
+  // Expression of the product of a vector (elements of type T1) and a scalar (of type T2),
+  // whose elements are of type T.
+  template <class E, class T1, class T2, class T, int N>
+  class VectorScaled : public VectorExpr<VectorScaled<E, T1, T2, T, N>, T, N>
+  {
+    typename ExprOperand<E>::type v;
+    T2 s;
+
+  public:
+    VectorScaled(const E &v, const T2 &s) : v(v), s(s) {}
+    inline T operator[](size_t i) const { return v[i] * s; }
+  };
+
   // The cross product of two vectors. Uses only the first 3 elements (zero the others in
   // the result). Throws runtime_error if the vectors have less than 3 elements.
-  template <class T, int N>
-  Vector<T, N> cross(const Vector<T, N> &u, const Vector<T, N> &v)
+  template <class E1, class E2, class T, int N>
+  Vector<T, N> cross(const VectorExpr<E1, T, N> &u, const VectorExpr<E2, T, N> &v)
   {
     if (N < 3)
       throw std::runtime_error("Vectors size is inferior to 3");
@@ -96,8 +217,8 @@ namespace aline
   }
 
   // The dot product of two vectors.
-  template <class T, int N>
-  T dot(const Vector<T, N> &u, const Vector<T, N> &v)
+  template <class E1, class E2, class T, int N>
+  T dot(const VectorExpr<E1, T, N> &u, const VectorExpr<E2, T, N> &v)
   {
     T result = 0;
     for (size_t i = 0; i < N; i++)
@@ -109,8 +230,8 @@ namespace aline
 
   // Tests if the vector contains NAN (not a number) values. (It is sometimes useful when
   // the result of a computation does not exist, e.g. division by zero).
-  template <class T, int N>
-  bool isnan(const Vector<T, N> &v)
+  template <class E, class T, int N>
+  bool isnan(const VectorExpr<E, T, N> &v)
   {
     for (size_t i = 0; i < N; i++)
     {
@@ -121,8 +242,8 @@ namespace aline
   }
 
   // Tests if the vector is a unit vector.
-  template <class T, int N>
-  bool is_unit(const Vector<T, N> &v)
+  template <class E, class T, int N>
+  bool is_unit(const VectorExpr<E, T, N> &v)
   {
     return std::round(norm(v)) == 1;
   }
@@ -131,8 +252,8 @@ namespace aline
   // they are very close, with respect to their magnitudes. For example, 1.0000001 can be
   // considered nearly equal to 1, whereas 1.234 is not nearly equal to 1.242. However,
   // because of their magnitude, 67329.234 can be considered nearly equal to 67329.242.1
-  template <class T, int N>
-  bool nearly_equal(const Vector<T, N> &u, const Vector<T, N> &v)
+  template <class E1, class E2, class T, int N>
+  bool nearly_equal(const VectorExpr<E1, T, N> &u, const VectorExpr<E2, T, N> &v)
   {
 
     for (size_t i = 0; i < N; ++i)
@@ -151,15 +272,15 @@ namespace aline
   }
 
   // The norm (magnitude) of the vector.
-  template <class T, int N>
-  double norm(const Vector<T, N> &v)
+  template <class E, class T, int N>
+  double norm(const VectorExpr<E, T, N> &v)
   {
     return sqrt(dot(v, v));
   }
 
   // Tests if two vectors contain the same values.
-  template <class T, int N>
-  bool operator==(const Vector<T, N> &u, const Vector<T, N> &v)
+  template <class E1, class E2, class T, int N>
+  bool operator==(const VectorExpr<E1, T, N> &u, const VectorExpr<E2, T, N> &v)
   {
     for (size_t i = 0; i < N; i++)
       if (u[i] != v[i])
@@ -169,8 +290,8 @@ namespace aline
   }
 
   // Test if two vectors contain different values.
-  template <class T, int N>
-  bool operator!=(const Vector<T, N> &u, const Vector<T, N> &v)
+  template <class E1, class E2, class T, int N>
+  bool operator!=(const VectorExpr<E1, T, N> &u, const VectorExpr<E2, T, N> &v)
   {
     for (size_t i = 0; i < N; i++)
       if (u[i] != v[i])
@@ -180,99 +301,73 @@ namespace aline
   }
 
   // Output operator.
-  template <class T, int N>
-  std::ostream &operator<<(std::ostream &out, const Vector<T, N> v)
+  template <class E, class T, int N>
+  std::ostream &operator<<(std::ostream &out, const VectorExpr<E, T, N> &v)
   {
     out << to_string(v) << std::endl;
     return out;
   }
 
   // The sum of two vectors.
-  template <class T, int N>
-  Vector<T, N> operator+(const Vector<T, N> &u, const Vector<T, N> &v)
+  template <class E1, class E2, class T, int N>
+  VectorSum<E1, E2, T, N> operator+(const VectorExpr<E1, T, N> &u, const VectorExpr<E2, T, N> &v)
   {
-    Vector<T, N> vec = Vector<T, N>();
-    for (size_t i = 0; i < N; ++i)
-    {
-      vec[i] = u[i] + v[i];
-    }
-    return vec;
+    return VectorSum<E1, E2, T, N>(static_cast<const E1 &>(u), static_cast<const E2 &>(v));
   }
 
   // The negation of a vector.
-  template <class T, int N>
-  Vector<T, N> operator-(const Vector<T, N> &v)
+  template <class E, class T, int N>
+  VectorScaled<E, T, int, T, N> operator-(const VectorExpr<E, T, N> &v)
   {
-    Vector<T, N> vec = Vector<T, N>();
-    for (size_t i = 0; i < N; ++i)
-    {
-      vec[i] = v[i] * (-1);
-    }
-    return vec;
+    return VectorScaled<E, T, int, T, N>(static_cast<const E &>(v), -1);
   }
 
   // The subtraction of two vectors.
-  template <class T, int N>
-  Vector<T, N> operator-(const Vector<T, N> &u, const Vector<T, N> &v)
+  template <class E1, class E2, class T, int N>
+  VectorDifference<E1, E2, T, N> operator-(const VectorExpr<E1, T, N> &u, const VectorExpr<E2, T, N> &v)
   {
-
-    Vector<T, N> vec = Vector<T, N>();
-    for (size_t i = 0; i < N; ++i)
-    {
-      vec[i] = u[i] - v[i];
-    }
-    return vec;
+    return VectorDifference<E1, E2, T, N>(static_cast<const E1 &>(u), static_cast<const E2 &>(v));
   }
 
-  // The product of a scalar and a vector.
-  template <class T1, class T2, int N>
-  Vector<T2, N> operator*(const T2 &s, const Vector<T1, N> &v)
+  // The product of a scalar and a vector (whose elements are then of the scalar's type).
+  template <class T1, class T2, int N, class E, class = typename std::enable_if<std::is_arithmetic<T2>::value>::type>
+  VectorScaled<E, T1, T2, T2, N> operator*(const T2 &s, const VectorExpr<E, T1, N> &v)
   {
-    Vector<T2, N> vec = Vector<T2, N>();
-    for (size_t i = 0; i < N; ++i)
-    {
-      vec[i] = v[i] * s;
-    }
-    return vec;
+    return VectorScaled<E, T1, T2, T2, N>(static_cast<const E &>(v), s);
   }
 
   // The product of a vector and a scalar.
-  template <class T1, class T2, int N>
-  Vector<T2, N> operator*(const Vector<T1, N> &v, const T2 &s)
+  template <class T1, class T2, int N, class E, class = typename std::enable_if<std::is_arithmetic<T2>::value>::type>
+  VectorScaled<E, T1, T2, T2, N> operator*(const VectorExpr<E, T1, N> &v, const T2 &s)
   {
     return s * v;
   }
 
   // The product of two vectors.
-  template <class T, int N>
-  Vector<T, N> operator*(const Vector<T, N> &u, const Vector<T, N> &v)
+  template <class E1, class E2, class T, int N>
+  VectorProduct<E1, E2, T, N> operator*(const VectorExpr<E1, T, N> &u, const VectorExpr<E2, T, N> &v)
   {
-    Vector<T, N> result = Vector<T, N>();
-    for (int i = 0; i < N; i++)
-    {
-      result[i] = u[i] * v[i];
-    }
-    return result;
+    return VectorProduct<E1, E2, T, N>(static_cast<const E1 &>(u), static_cast<const E2 &>(v));
   }
 
   // The division of a vector by a scalar (same as the multiplication by 1/s).
-  template <class T1, class T2, int N>
-  Vector<T1, N> operator/(const Vector<T1, N> &v, const T2 &s)
+  template <class T1, class T2, int N, class E, class = typename std::enable_if<std::is_arithmetic<T2>::value>::type>
+  VectorScaled<E, T1, decltype(1 / T2()), T1, N> operator/(const VectorExpr<E, T1, N> &v, const T2 &s)
   {
-    return (1 / s) * v;
+    return VectorScaled<E, T1, decltype(1 / T2()), T1, N>(static_cast<const E &>(v), 1 / s);
   }
 
   // The square of the norm (magnitude) of the vector.
-  template <class T, int N>
-  float sq_norm(const Vector<T, N> &v)
+  template <class E, class T, int N>
+  float sq_norm(const VectorExpr<E, T, N> &v)
   {
     float n = norm(v);
     return n * n;
   }
 
   // A string representation of a vector.
-  template <class T, int N>
-  std::string to_string(const Vector<T, N> &v)
+  template <class E, class T, int N>
+  std::string to_string(const VectorExpr<E, T, N> &v)
   {
     std::stringstream ss;
     // ss.precision(6);
@@ -286,8 +381,8 @@ namespace aline
   }
 
   // The vector normalized.
-  template <class T, int N>
-  Vector<T, N> unit_vector(const Vector<T, N> &v)
+  template <class E, class T, int N>
+  Vector<T, N> unit_vector(const VectorExpr<E, T, N> &v)
   {
     return v / norm(v);
   }
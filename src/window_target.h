@@ -0,0 +1,121 @@
+#include <iostream>
+#include <string>
+#include "window.h"
+#include "render_target.h"
+
+#ifndef WINDOW_TARGET_H
+
+#define WINDOW_TARGET_H
+
+/*
+  A render target shown in a MinWin window. Framebuffers are sent to the window through
+  one streaming texture.
+*/
+class WindowTarget : public RenderTarget
+{
+  minwin::Window window;
+  std::string font_file;
+  SDL_Texture *buffer_texture;
+  int texture_width, texture_height;
+
+public:
+  WindowTarget(const std::string &title, unsigned int width, unsigned int height, const std::string &font_file)
+      : font_file(font_file), buffer_texture(nullptr), texture_width(0), texture_height(0)
+  {
+    window.set_title(title);
+    window.set_width(width);
+    window.set_height(height);
+  }
+
+  ~WindowTarget()
+  {
+    window.destroy_buffer_texture(buffer_texture);
+  }
+
+  bool open()
+  {
+    // load font
+    if (not window.load_font(font_file, 16u))
+    {
+      std::cerr << "Couldn't load font.\n";
+    }
+
+    // open window
+    if (not window.open())
+    {
+      std::cerr << "Couldn't open window.\n";
+      return false;
+    }
+    return true;
+  }
+
+  void close()
+  {
+    window.destroy_buffer_texture(buffer_texture);
+    buffer_texture = nullptr;
+    texture_width = texture_height = 0;
+    window.close();
+  }
+
+  void register_quit_behavior(minwin::IButtonBehavior *const behavior)
+  {
+    window.register_quit_behavior(behavior);
+  }
+
+  void register_key_behavior(minwin::KeyCode key, minwin::IKeyBehavior *const behavior)
+  {
+    window.register_key_behavior(key, behavior);
+  }
+
+  void process_input()
+  {
+    window.process_input();
+  }
+
+  void clear(const minwin::Color &color)
+  {
+    window.clear(color);
+  }
+
+  void set_draw_color(const minwin::Color &color)
+  {
+    window.set_draw_color(color);
+  }
+
+  void put_pixel(int x, int y)
+  {
+    window.put_pixel(x, y);
+  }
+
+  bool put_buffer(const FrameBuffer &fb, int x, int y)
+  {
+    // (re)create the streaming texture when the buffer size changes
+    if (texture_width != fb.get_width() || texture_height != fb.get_height())
+    {
+      window.destroy_buffer_texture(buffer_texture);
+      buffer_texture = window.create_buffer_texture(fb.get_width(), fb.get_height());
+      texture_width = fb.get_width();
+      texture_height = fb.get_height();
+      if (buffer_texture == nullptr)
+      {
+        std::cerr << "Couldn't create the framebuffer texture.\n";
+      }
+    }
+    if (buffer_texture == nullptr)
+      return false;
+    window.put_buffer(buffer_texture, fb.data(), x, y);
+    return true;
+  }
+
+  void render_text(const minwin::Text &text)
+  {
+    window.render_text(text);
+  }
+
+  void display()
+  {
+    window.display();
+  }
+};
+
+#endif
@@ -0,0 +1,156 @@
+//
+// File       : bench_aline.cpp
+// Licence    : see LICENCE
+// Maintainer : Maxence BOISÉDU
+//
+// Microbenchmarks of the aline operators (expression templates and fused products)
+// against the previous implementations, which built a temporary vector per operator,
+// of the matrix inverses and of the batched frustum test.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "matrix.h"
+
+using namespace aline;
+
+// The previous operators: each one returns a new zero-initialised vector, and products
+// build a column and an element-wise product vector for each element.
+namespace before
+{
+  Vec4r add(const Vec4r &u, const Vec4r &v)
+  {
+    Vec4r vec = Vec4r();
+    for (size_t i = 0; i < 4; ++i)
+      vec[i] = u[i] + v[i];
+    return vec;
+  }
+
+  Vec4r scale(real s, const Vec4r &v)
+  {
+    Vec4r vec = Vec4r();
+    for (size_t i = 0; i < 4; ++i)
+      vec[i] = v[i] * s;
+    return vec;
+  }
+
+  Vec4r mul(const Vec4r &u, const Vec4r &v)
+  {
+    Vec4r result = Vec4r();
+    for (int i = 0; i < 4; i++)
+      result[i] = u[i] * v[i];
+    return result;
+  }
+
+  Vec4r mul(const Mat44r &m, const Vec4r &v)
+  {
+    Vec4r result = Vec4r();
+    for (int i = 0; i < 4; ++i)
+    {
+      Vec4r row = m[i];
+      Vec4r prod = mul(v, row);
+      for (int j = 0; j < 4; ++j)
+        result[i] += prod[j];
+    }
+    return result;
+  }
+
+  Mat44r mul(const Mat44r &m1, const Mat44r &m2)
+  {
+    Mat44r result = Mat44r();
+    for (int i = 0; i < 4; ++i)
+    {
+      Vec4r v1 = m1[i];
+      for (int j = 0; j < 4; ++j)
+      {
+        Vec4r v2 = Vec4r();
+        for (int k = 0; k < 4; ++k)
+          v2[k] = m2[k][j];
+        Vec4r prod = mul(v1, v2);
+        for (int p = 0; p < 4; ++p)
+          result[i][j] += prod[p];
+      }
+    }
+    return result;
+  }
+}
+
+// Runs f iterations times and prints the time per iteration.
+template <class F>
+void bench(const std::string &name, long iterations, F f)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i)
+    f();
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+  std::cout << name << ": " << ns << " ns" << std::endl;
+}
+
+int main()
+{
+  const long n = 5000000;
+  Vec4r a{1.0, 2.0, 3.0, 4.0}, b{0.5, 0.25, 0.125, 1.0}, c{-1.0, 1.0, -1.0, 1.0};
+  real s = 0.999;
+  // a rotation (so that repeated products neither vanish nor overflow) and a translation
+  real co = cos(0.01), si = sin(0.01);
+  Mat44r m{{co, si, 0.0, 1.0}, {-si, co, 0.0, 2.0}, {0.0, 0.0, 1.0, 3.0}, {0.0, 0.0, 0.0, 1.0}};
+
+  // each result is fed back so that nothing can be optimised away
+  Vec4r r = a;
+  bench("a*b + c*s (before)", n, [&]() { r = before::add(before::mul(r, b), before::scale(s, c)); });
+  std::cout << "  checksum " << dot(r, r) << std::endl;
+  r = a;
+  bench("a*b + c*s (fused) ", n, [&]() { r = r * b + c * s; });
+  std::cout << "  checksum " << dot(r, r) << std::endl;
+
+  r = a;
+  bench("Mat44r * Vec4r (before)", n, [&]() { r = before::mul(m, r); });
+  std::cout << "  checksum " << dot(r, r) << std::endl;
+  r = a;
+  bench("Mat44r * Vec4r (fused) ", n, [&]() { r = m * r; });
+  std::cout << "  checksum " << dot(r, r) << std::endl;
+
+  Mat44r p = m;
+  bench("Mat44r * Mat44r (before)", n / 5, [&]() { p = before::mul(p, m); });
+  std::cout << "  checksum " << p.at(0, 3) << std::endl;
+  p = m;
+  bench("Mat44r * Mat44r (fused) ", n / 5, [&]() { p = p * m; });
+  std::cout << "  checksum " << p.at(0, 3) << std::endl;
+
+  Mat44r q;
+  bench("inverse( Mat44r ) (Gauss-Jordan)", n / 5, [&]() { q = inverse(m); m[0][3] += q[0][3] * 1e-9; });
+  std::cout << "  checksum " << q.at(0, 3) << std::endl;
+  bench("inverse_cofactors( Mat44r )     ", n / 5, [&]() { q = inverse_cofactors(m); m[0][3] += q[0][3] * 1e-9; });
+  std::cout << "  checksum " << q.at(0, 3) << std::endl;
+  bench("inverse_affine( Mat44r )        ", n / 5, [&]() { q = inverse_affine(m); m[0][3] += q[0][3] * 1e-9; });
+  std::cout << "  checksum " << q.at(0, 3) << std::endl;
+  bench("inverse_rigid( Mat44r )         ", n / 5, [&]() { q = inverse_rigid(m); m[0][3] += q[0][3] * 1e-9; });
+  std::cout << "  checksum " << q.at(0, 3) << std::endl;
+
+  // frustum test of many objects, scattered around the unit cube
+  const size_t objects = 10000;
+  std::vector<real> bx(objects), by(objects), bz(objects), be(objects), br(objects);
+  for (size_t i = 0; i < objects; ++i)
+  {
+    bx[i] = (i % 37) / 9.0 - 2;
+    by[i] = (i % 23) / 5.5 - 2;
+    bz[i] = (i % 11) / 2.5 - 2;
+    be[i] = 0.1 + (i % 5) * 0.05;
+    br[i] = be[i] * 1.5;
+  }
+  real planes[6][4] = {{1, 0, 0, 1}, {-1, 0, 0, 1}, {0, 1, 0, 1}, {0, -1, 0, 1}, {0, 0, 1, 1}, {0, 0, -1, 1}};
+  std::vector<uint8_t> visible(objects);
+  const char *names[] = {"scalar", "sse2", "avx2"};
+  for (int level = simd_scalar; level <= simd_level(); ++level)
+  {
+    bench(std::string("cull_bounds( 10000 objects, ") + names[level] + " )", n / 5000, [&]()
+          { cull_bounds(planes, bx.data(), by.data(), bz.data(), be.data(), be.data(), be.data(), br.data(), objects,
+                        visible.data(), (SimdLevel)level); });
+    std::cout << "  visible " << std::count(visible.begin(), visible.end(), 1) << std::endl;
+  }
+
+  return 0;
+}
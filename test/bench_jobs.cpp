@@ -0,0 +1,77 @@
+//
+// File       : bench_jobs.cpp
+// Licence    : see LICENCE
+// Maintainer : Maxence BOISÉDU
+//
+// Benchmark of the vertex stage split among the threads of a job system: the vertices of
+// a large shape are transformed and given their outcode as in Scene::vertex_stage, with
+// 1 to N threads (N being the number of cores, at least 4).
+//
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "scene.h"
+
+// Runs f iterations times and returns the time per iteration, in milliseconds.
+template <class F>
+double bench(long iterations, F f)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i)
+    f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+int main()
+{
+  // a 1024 x 1024 grid of vertices, in front of the camera
+  const uint32_t side = 1024;
+  Mesh mesh;
+  mesh.reserve((size_t)side * side, (size_t)(side - 1) * (side - 1) * 2);
+  for (uint32_t j = 0; j < side; ++j)
+    for (uint32_t i = 0; i < side; ++i)
+      mesh.add_vertex(i * 4.0 / side - 2, j * 4.0 / side - 2, 5.0 + (i + j) % 7 * 0.1);
+  for (uint32_t j = 0; j + 1 < side; ++j)
+    for (uint32_t i = 0; i + 1 < side; ++i)
+    {
+      uint32_t v = j * side + i;
+      mesh.add_face(v, v + 1, v + side, minwin::WHITE);
+      mesh.add_face(v + 1, v + side + 1, v + side, minwin::WHITE);
+    }
+  Shape shape("grid", mesh);
+  const Mesh &m = shape.get_mesh();
+  size_t n = m.vertex_count();
+
+  aline::Mat44r transform{{1.2, 0.0, 0.1, 0.0}, {0.0, 1.2, 0.0, 0.0}, {0.0, 0.0, 0.0, 1.0}, {0.0, 0.0, 1.0, 0.0}};
+  std::vector<aline::real> px(n), py(n), pz(n);
+  std::vector<uint8_t> clip(n);
+
+  unsigned max_threads = std::max(std::thread::hardware_concurrency(), 4u);
+  double serial = 0;
+  std::cout << "transform_points( " << n << " vertices )" << std::endl;
+  for (unsigned threads = 1; threads <= max_threads; ++threads)
+  {
+    JobSystem jobs(threads);
+    double ms = bench(50, [&]()
+                      {
+                        jobs.parallel_for(0, n, VERTEX_GRAIN, [&](size_t begin, size_t end)
+                                          {
+                                            aline::transform_points(transform, m.get_x().data() + begin, m.get_y().data() + begin,
+                                                                    m.get_z().data() + begin, end - begin, px.data() + begin,
+                                                                    py.data() + begin, pz.data() + begin);
+                                            for (size_t v = begin; v < end; ++v)
+                                              clip[v] = clip_outcode(px[v], py[v], pz[v]);
+                                          });
+                      });
+    if (threads == 1)
+      serial = ms;
+    std::cout << "  " << threads << (threads == 1 ? " thread:  " : " threads: ") << ms << " ms (x" << serial / ms
+              << ")" << std::endl;
+  }
+  std::cout << "  checksum " << px[n / 3] + py[n / 2] + clip[n - 1] << std::endl;
+
+  return 0;
+}
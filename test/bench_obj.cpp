@@ -0,0 +1,134 @@
+//
+// File       : bench_obj.cpp
+// Licence    : see LICENCE
+// Maintainer : Maxence BOISÉDU
+//
+// Load-time benchmark (in megabytes per second) of the OBJ loader, against the previous
+// one (getline and an istringstream per line). It loads the file given as argument, or
+// else writes then loads a grid of about a million vertices and two million triangles.
+//
+// Usage: bench_obj [file.obj]
+//
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "obj_loader.h"
+
+// The previous loader, from test_scene.
+namespace before
+{
+  void load_obj(const std::string &file, Mesh &mesh)
+  {
+    std::ifstream f(file);
+    std::string str;
+    while (f.good())
+    {
+      std::getline(f, str);
+
+      if (str[0] == 'f')
+      {
+        std::vector<uint> ids;
+        std::istringstream iss(str);
+        char pass; // pass the 'v'
+        iss >> pass;
+        do
+        {
+          uint subs;
+          iss >> subs;
+          ids.push_back(subs);
+        } while (iss);
+        mesh.add_face(ids[0] - 1, ids[1] - 1, ids[2] - 1, minwin::WHITE);
+      }
+      else if (str[0] == 'v')
+      {
+        std::vector<aline::real> values;
+        std::istringstream iss(str);
+        char pass; // pass the 'v'
+        iss >> pass;
+        do
+        {
+          aline::real subs;
+          iss >> subs;
+          values.push_back(subs);
+        } while (iss);
+        mesh.add_vertex(values[0], values[1], values[2]);
+      }
+    }
+  }
+}
+
+// Writes a side x side grid of vertices, two triangles per cell.
+bool write_grid(const std::string &file_name, int side)
+{
+  FILE *f = std::fopen(file_name.c_str(), "w");
+  if (f == nullptr)
+    return false;
+  std::fprintf(f, "# %d x %d grid\n", side, side);
+  for (int j = 0; j < side; ++j)
+    for (int i = 0; i < side; ++i)
+      std::fprintf(f, "v %.6f %.6f %.6f\n", i * 0.01 - 5, j * 0.01 - 5, ((i * 7 + j * 13) % 100) * 0.001);
+  for (int j = 0; j + 1 < side; ++j)
+    for (int i = 0; i + 1 < side; ++i)
+    {
+      int v = j * side + i + 1;
+      std::fprintf(f, "f %d %d %d\nf %d %d %d\n", v, v + 1, v + side, v + 1, v + side + 1, v + side);
+    }
+  return std::fclose(f) == 0;
+}
+
+// Loads the file iterations times with load and prints the load rate, and the size of the
+// mesh.
+template <class F>
+void bench(const std::string &name, const std::string &file, long iterations, double megabytes, F load)
+{
+  Mesh mesh;
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i)
+  {
+    mesh = Mesh();
+    load(file, mesh);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double s = std::chrono::duration<double>(end - start).count() / iterations;
+  std::cout << name << ": " << megabytes / s << " MB/s (" << s * 1000 << " ms)" << std::endl;
+  std::cout << "  " << mesh.vertex_count() << " vertices, " << mesh.face_count() << " faces" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  std::string file = "bench_obj_grid.obj";
+  bool generated = argc < 2;
+  if (generated)
+  {
+    if (!write_grid(file, 1000))
+    {
+      std::cerr << "Couldn't write " << file << std::endl;
+      return 1;
+    }
+  }
+  else
+    file = argv[1];
+
+  MappedFile mapped(file);
+  if (!mapped.is_open())
+  {
+    std::cerr << "Couldn't read " << file << std::endl;
+    return 1;
+  }
+  double megabytes = mapped.size() / 1e6;
+  std::cout << file << ": " << megabytes << " MB" << std::endl;
+
+  bench("getline + istringstream (before)", file, 1, megabytes, [](const std::string &f, Mesh &m)
+        { before::load_obj(f, m); });
+  bench("load_obj (mmap)                 ", file, 5, megabytes, [](const std::string &f, Mesh &m)
+        { load_obj(f, m); });
+
+  if (generated)
+    std::remove(file.c_str());
+  return 0;
+}
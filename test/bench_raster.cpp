@@ -0,0 +1,87 @@
+//
+// File       : bench_raster.cpp
+// Licence    : see LICENCE
+// Maintainer : Maxence BOISÉDU
+//
+// Microbenchmarks of the fill rate (in megapixels per second) of the span fill kernels,
+// on whole framebuffers and on spans of a few lengths, and of filled triangles, plotted
+// pixel by pixel or by spans.
+//
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "raster.h"
+
+// Runs f iterations times and prints the fill rate, f writing pixels pixels.
+template <class F>
+void bench(const std::string &name, long iterations, double pixels, F f)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i)
+    f();
+  auto end = std::chrono::steady_clock::now();
+  double us = std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+  std::cout << name << ": " << pixels / us << " Mpixels/s" << std::endl;
+}
+
+int main()
+{
+  const int size = 700;
+  FrameBuffer fb(size, size);
+  const char *names[] = {"scalar", "sse2", "avx2"};
+
+  // whole buffer
+  for (int level = aline::simd_scalar; level <= aline::simd_level(); ++level)
+    bench(std::string("clear( 700 x 700, ") + names[level] + " )", 2000, (double)size * size, [&]()
+          { fill_span(fb.data(), (size_t)size * size, 0xff000000u + level, (aline::SimdLevel)level); });
+  std::cout << "  checksum " << fb.get_pixel(size - 1, size - 1) << std::endl;
+
+  // spans of each row, starting at every alignment
+  int lengths[] = {5, 8, 37, 300};
+  for (int n : lengths)
+    for (int level = aline::simd_scalar; level <= aline::simd_level(); ++level)
+    {
+      double pixels = 0;
+      for (int y = 0; y < size; ++y)
+        for (int x = y % 8; x + n <= size; x += n + 1)
+          pixels += n;
+      bench(std::string("fill_span( n = ") + std::to_string(n) + ", " + names[level] + " )", 200, pixels, [&]()
+            {
+              for (int y = 0; y < size; ++y)
+                for (int x = y % 8; x + n <= size; x += n + 1)
+                  fill_span(fb.data() + (size_t)y * size + x, n, 0xff00ff00u, (aline::SimdLevel)level);
+            });
+    }
+  std::cout << "  checksum " << fb.get_pixel(size / 2, size / 2) << std::endl;
+
+  // a triangle over half of the buffer, each time in front of the previous one (so that
+  // the depth test is not needed)
+  DepthBuffer depth(size, size);
+  PixelRect all{0, 0, size - 1, size - 1};
+  aline::Vec2i p0{0, 0}, p1{(size - 1) * RASTER_SUBPIXEL, 0}, p2{0, (size - 1) * RASTER_SUBPIXEL};
+  double triangle = 0;
+  fill_triangle(p0, p1, p2, 0.5f, 0.5f, 0.5f, all, depth, [&](int, int, int n)
+                { triangle += n; });
+  uint32_t *pixels = fb.data();
+  float z = 0.5f;
+  bench("fill_triangle( pixel by pixel )", 500, triangle, [&]()
+        {
+          z += 1e-4f;
+          fill_triangle(p0, p1, p2, z, z, z, all, depth, [=](int x, int y, int n)
+                        {
+                          for (int i = 0; i < n; ++i)
+                            pixels[(size_t)y * size + x + i] = 0xffff0000u;
+                        });
+        });
+  bench("fill_triangle( spans )         ", 500, triangle, [&]()
+        {
+          z += 1e-4f;
+          fill_triangle(p0, p1, p2, z, z, z, all, depth, [=](int x, int y, int n)
+                        { fill_span(pixels + (size_t)y * size + x, n, 0xff0000ffu); });
+        });
+  std::cout << "  checksum " << fb.get_pixel(1, 1) << std::endl;
+
+  return 0;
+}
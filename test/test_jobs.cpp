@@ -0,0 +1,147 @@
+//
+// File       : test_jobs.cpp
+// Licence    : see LICENCE
+// Maintainer : Maxence BOISÉDU
+//
+// Tests the job system: parallel loops, nested loops and groups of jobs.
+//
+
+#include <atomic>
+#include <vector>
+#include "unit_test.h"
+#include "jobs.h"
+
+// Whether parallel_for calls f once per index of [begin, end), with ranges of at least
+// grain indices (unless there is only one).
+bool covers_once(JobSystem &jobs, size_t begin, size_t end, size_t grain)
+{
+  std::vector<std::atomic<int>> hits(end);
+  std::atomic<bool> small_range(false);
+  for (std::atomic<int> &h : hits)
+    h = 0;
+  jobs.parallel_for(begin, end, grain, [&](size_t b, size_t e)
+                    {
+                      if (e - b < grain && (b != begin || e != end))
+                        small_range = true;
+                      for (size_t i = b; i < e; ++i)
+                        ++hits[i];
+                    });
+  for (size_t i = 0; i < end; ++i)
+    if (hits[i] != (i >= begin ? 1 : 0))
+      return false;
+  return !small_range;
+}
+
+int test_parallel_for()
+{
+  bool once[3] = {true, true, true};
+  unsigned thread_counts[] = {1, 2, 4};
+  for (int t = 0; t < 3; ++t)
+  {
+    JobSystem jobs(thread_counts[t]);
+    for (size_t grain : {1, 7, 64, 5000})
+      once[t] = once[t] && covers_once(jobs, 0, 1000, grain) && covers_once(jobs, 13, 1000, grain) &&
+                covers_once(jobs, 0, 1, grain) && covers_once(jobs, 5, 5, grain);
+  }
+
+  TestVector tests{
+      {"1 thread calls each index once", once[0]},
+      {"2 threads call each index once", once[1]},
+      {"4 threads call each index once", once[2]}};
+
+  return run_tests("parallel_for", tests);
+}
+
+int test_nested_parallel_for()
+{
+  // each job of the outer loop runs an inner loop, and waits for it
+  JobSystem jobs(4);
+  std::atomic<long> sum(0);
+  jobs.parallel_for(0, 16, 1, [&](size_t b, size_t e)
+                    {
+                      for (size_t i = b; i < e; ++i)
+                        jobs.parallel_for(0, 100, 8, [&](size_t ib, size_t ie)
+                                          {
+                                            for (size_t j = ib; j < ie; ++j)
+                                              sum += i * 100 + j;
+                                          });
+                    });
+
+  TestVector tests{
+      {"nested loops call each index once", sum == 1600L * 1599 / 2}};
+
+  return run_tests("nested parallel_for", tests);
+}
+
+int test_job_groups()
+{
+  JobSystem jobs(3);
+  std::atomic<int> a(0), b(0);
+  auto add_a = [&]()
+  { ++a; };
+  auto add_b = [&](size_t begin, size_t end)
+  { b += end - begin; };
+
+  JobGroup first, second;
+  for (int i = 0; i < 50; ++i)
+    jobs.run(first, add_a);
+  for (int i = 0; i < 10; ++i)
+    jobs.run(second, add_b, 0, 7);
+  jobs.wait(first);
+  bool first_done = first.done() && a == 50;
+  jobs.wait(second);
+  bool second_done = second.done() && b == 70;
+
+  // waiting for a group without jobs returns at once
+  JobGroup empty;
+  jobs.wait(empty);
+
+  TestVector tests{
+      {"wait returns once the jobs of the group are done", first_done},
+      {"each group is waited for on its own", second_done},
+      {"an empty group is done", empty.done()}};
+
+  return run_tests("job groups", tests);
+}
+
+int test_thread_count()
+{
+  JobSystem jobs(1);
+  bool one = jobs.get_thread_count() == 1;
+  jobs.set_thread_count(4);
+  bool four = jobs.get_thread_count() == 4 && covers_once(jobs, 0, 1000, 10);
+  jobs.set_thread_count(2);
+  bool two = jobs.get_thread_count() == 2 && covers_once(jobs, 0, 1000, 10);
+  jobs.set_thread_count(0);
+  bool at_least_one = jobs.get_thread_count() == 1 && covers_once(jobs, 0, 1000, 10);
+
+  TestVector tests{
+      {"a system of 1 thread has no worker", one},
+      {"threads can be added", four},
+      {"threads can be removed", two},
+      {"there is always a thread", at_least_one}};
+
+  return run_tests("thread count", tests);
+}
+
+int main()
+{
+  int failures{0};
+
+  failures += test_parallel_for();
+  failures += test_nested_parallel_for();
+  failures += test_job_groups();
+  failures += test_thread_count();
+
+  if (failures > 0)
+  {
+    std::cout << "Total failures : " << failures << std::endl;
+    std::cout << "THE TEST FAILED!!" << std::endl;
+    return 1;
+  }
+  else
+  {
+    std::cout << "Success!" << std::endl;
+    return 0;
+  }
+}
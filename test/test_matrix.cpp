@@ -312,6 +312,118 @@ int test_inverse()
   return run_tests("inverse( Matrix )", test_vec);
 }
 
+int test_inverse_special()
+{
+  // rotation of 30 degrees around z, then translation
+  real c = cos(M_PI / 6), s = sin(M_PI / 6);
+  Mat44r rigid{{c, -s, 0, 1}, {s, c, 0, 2}, {0, 0, 1, 3}, {0, 0, 0, 1}};
+  // rotation, non uniform scaling and translation
+  Mat44r affine{{2 * c, -s, 0, -4}, {2 * s, c, 0, 0.5}, {0, 0, 3, 7}, {0, 0, 0, 1}};
+  // projective (last row is not 0 0 0 1)
+  Mat44r general{{2, 3, 8, 1}, {6, 0, -3, 2}, {-1, 3, 2, 0}, {0.5, 0, 1, 4}};
+  Mat44r singular{{1, 2, 3, 4}, {2, 4, 6, 8}, {0, 1, 0, 1}, {1, 0, 0, 1}};
+  Mat44r identity{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+
+  TestVector test_vec{
+      {"inverse_rigid( rigid ) == inverse( rigid )", nearly_equal(inverse_rigid(rigid), inverse(rigid))},
+      {"inverse_rigid( rigid ) * rigid == identity", nearly_equal(inverse_rigid(rigid) * rigid + identity, identity + identity)},
+      {"inverse_affine( rigid ) == inverse( rigid )", nearly_equal(inverse_affine(rigid), inverse(rigid))},
+      {"inverse_affine( affine ) == inverse( affine )", nearly_equal(inverse_affine(affine), inverse(affine))},
+      {"inverse_cofactors( affine ) == inverse( affine )", nearly_equal(inverse_cofactors(affine), inverse(affine))},
+      {"inverse_cofactors( general ) == inverse( general )", nearly_equal(inverse_cofactors(general), inverse(general))},
+      {"isnan( inverse_cofactors( singular ) )", isnan(inverse_cofactors(singular))},
+      {"isnan( inverse_affine( singular ) )", isnan(inverse_affine(Mat44r{{1, 2, 3, 0}, {2, 4, 6, 0}, {0, 1, 0, 0}, {0, 0, 0, 1}}))}};
+
+  return run_tests("inverse_rigid/affine/cofactors( Matrix )", test_vec);
+}
+
+int test_transform_points()
+{
+  Mat44r m{{1, 2, 3, 4}, {-2, 0.5, 1, 0}, {0.25, 0, 1, -1}, {0, 0, 1, 0}};
+
+  // odd number of points to exercise the tails of the kernels, the fourth one has w == 0
+  const size_t n = 11;
+  real x[n], y[n], z[n];
+  for (size_t i = 0; i < n; ++i)
+  {
+    x[i] = 1.5 * i - 4;
+    y[i] = 0.75 * i * i - 3;
+    z[i] = i == 3 ? 0.0 : 0.5 + i;
+  }
+
+  // expected values, with operator*( Matrix, Vector )
+  Vector<real, 3> expected[n];
+  for (size_t i = 0; i < n; ++i)
+  {
+    Vector<real, 4> p = m * Vector<real, 4>{x[i], y[i], z[i], 1.0};
+    if (p[3] != 0)
+      expected[i] = Vector<real, 3>{p[0] / p[3], p[1] / p[3], p[2] / p[3]};
+  }
+
+  TestVector test_vec;
+  const char *names[] = {"scalar", "sse2", "avx2"};
+  for (int level = simd_scalar; level <= simd_level(); ++level)
+  {
+    real ox[n], oy[n], oz[n];
+    transform_points(m, x, y, z, n, ox, oy, oz, (SimdLevel)level);
+
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i)
+      ok = ok && nearly_equal(Vector<real, 3>{ox[i], oy[i], oz[i]}, expected[i]);
+    test_vec.push_back({std::string("transform_points( ") + names[level] + " ) == m * p / w", ok});
+  }
+
+  return run_tests("transform_points( Matrix, points )", test_vec);
+}
+
+int test_cull_bounds()
+{
+  // the cube [-1, 1]^3, with one plane given with a non unit normal
+  real planes[6][4] = {{1, 0, 0, 1}, {-2, 0, 0, 2}, {0, 1, 0, 1}, {0, -1, 0, 1}, {0, 0, 1, 1}, {0, 0, -1, 1}};
+
+  // center x and y, half extent (the same along each axis), radius and expected result
+  struct Case
+  {
+    real x, y, e, r;
+    uint8_t visible;
+  };
+  Case cases[] = {{0, 0, 0.1, 0.1, 1},     // inside
+                  {3, 0, 1, 1.7, 0},       // outside
+                  {-1.5, 0, 1, 1.7, 1},    // across a plane
+                  {1.5, 0, 1, 0.3, 0},     // box across a plane, but not the sphere
+                  {1.5, 0, 0.2, 1, 0},     // sphere across a plane, but not the box
+                  {1.5, 1.5, 0.6, 0.85, 1}, // near a corner (kept, the test is conservative)
+                  {0, -4, 0.5, 0.5, 0}};   // outside
+
+  // odd number of volumes to exercise the tails of the kernels
+  const size_t n = 11;
+  real x[n], y[n], z[n], ex[n], ey[n], ez[n], r[n];
+  for (size_t i = 0; i < n; ++i)
+  {
+    const Case &c = cases[i % 7];
+    x[i] = c.x;
+    y[i] = c.y;
+    z[i] = 0;
+    ex[i] = ey[i] = ez[i] = c.e;
+    r[i] = c.r;
+  }
+
+  TestVector test_vec;
+  const char *names[] = {"scalar", "sse2", "avx2"};
+  for (int level = simd_scalar; level <= simd_level(); ++level)
+  {
+    uint8_t visible[n];
+    cull_bounds(planes, x, y, z, ex, ey, ez, r, n, visible, (SimdLevel)level);
+
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i)
+      ok = ok && visible[i] == cases[i % 7].visible;
+    test_vec.push_back({std::string("cull_bounds( ") + names[level] + " )", ok});
+  }
+
+  return run_tests("cull_bounds( planes, bounds )", test_vec);
+}
+
 int main()
 {
   int failures{0};
@@ -333,6 +445,9 @@ int main()
   failures += test_to_string();
   failures += test_transpose();
   failures += test_inverse();
+  failures += test_inverse_special();
+  failures += test_transform_points();
+  failures += test_cull_bounds();
 
   failures += test_operator_output();
 
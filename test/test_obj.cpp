@@ -0,0 +1,174 @@
+//
+// File       : test_obj.cpp
+// Licence    : see LICENCE
+// Maintainer : Maxence BOISÉDU
+//
+// Tests the OBJ loader: number parsing, vertex and face lines, and loading a file.
+//
+
+#include <cstdlib> // std::strtod
+#include <string>
+#include "unit_test.h"
+#include "obj_loader.h"
+
+// Whether parse_real reads the whole text as value (exactly).
+bool parses(const std::string &text, aline::real value)
+{
+  const char *p = text.data();
+  aline::real v = -12345;
+  return parse_real(p, text.data() + text.size(), v) && p == text.data() + text.size() && v == value;
+}
+
+// Whether parse_real reads text as strtod does.
+bool parses_as_strtod(const std::string &text)
+{
+  return parses(text, std::strtod(text.c_str(), nullptr));
+}
+
+Mesh parse(const std::string &text)
+{
+  Mesh mesh;
+  parse_obj(text.data(), text.data() + text.size(), mesh);
+  return mesh;
+}
+
+// Whether the face f of the mesh has the vertices v0, v1 and v2.
+bool has_face(const Mesh &mesh, size_t f, uint32_t v0, uint32_t v1, uint32_t v2)
+{
+  const std::vector<uint32_t> &indices = mesh.get_indices();
+  return f < mesh.face_count() && indices[3 * f] == v0 && indices[3 * f + 1] == v1 && indices[3 * f + 2] == v2;
+}
+
+int test_parse_real()
+{
+  bool plain = parses("0", 0) && parses("42", 42) && parses("-3", -3) && parses("+7", 7) && parses("2.5", 2.5) &&
+               parses("-0.125", -0.125) && parses(".5", 0.5) && parses("5.", 5);
+  bool exponents = parses("1e3", 1000) && parses("2.5E-2", 0.025) && parses("-4e+1", -40) && parses("1e0", 1);
+  bool as_strtod = parses_as_strtod("40.6266") && parses_as_strtod("-1.10804") && parses_as_strtod("0.000123456") &&
+                   parses_as_strtod("123456789012345") && parses_as_strtod("3.14159265358979") &&
+                   parses_as_strtod("1.5e-7") && parses_as_strtod("6.02214076e23");
+  // far from the fast path, a few units in the last place
+  aline::real big = 0;
+  const char *text = "1.2345678901234567890123e200";
+  const char *p = text;
+  bool close = parse_real(p, text + strlen(text), big) && std::fabs(big / 1.2345678901234567890123e200 - 1) < 1e-14;
+  // (and with an exponent in the subnormal range)
+  const char *tiny_text = "123456789012345678901234567890e-330";
+  aline::real tiny = 0;
+  p = tiny_text;
+  close = close && parse_real(p, tiny_text + strlen(tiny_text), tiny) &&
+          std::fabs(tiny / std::strtod(tiny_text, nullptr) - 1) < 1e-14;
+
+  // the number stops at the first other character, and there must be one digit
+  std::string rest = "1.5/2";
+  p = rest.data();
+  aline::real v;
+  bool stops = parse_real(p, rest.data() + rest.size(), v) && v == 1.5 && *p == '/';
+  std::string none[] = {"", "-", ".", "e5", "x1", "+.e1"};
+  bool no_number = true;
+  for (const std::string &t : none)
+  {
+    p = t.data();
+    no_number = no_number && !parse_real(p, t.data() + t.size(), v) && p == t.data();
+  }
+  // an exponent without digits is not part of the number
+  std::string e = "2e";
+  p = e.data();
+  bool lone_e = parse_real(p, e.data() + e.size(), v) && v == 2 && p == e.data() + 1;
+
+  TestVector tests{
+      {"plain numbers", plain},
+      {"exponents", exponents},
+      {"same as strtod", as_strtod},
+      {"many digits", close},
+      {"stops after the number", stops},
+      {"no number", no_number},
+      {"exponent without digits", lone_e}};
+
+  return run_tests("parse_real", tests);
+}
+
+int test_parse_obj()
+{
+  Mesh vertices = parse("# a comment\n"
+                        "v 1 2 3\n"
+                        "v  -1.5\t2e1  0.25 1.0\r\n"
+                        "vn 0 0 1\n"
+                        "vt 0.5 0.5\n"
+                        "  v 4 5 6\n"
+                        "v 7 8");
+  bool coordinates = vertices.vertex_count() == 4 && vertices.get_x()[1] == -1.5 && vertices.get_y()[1] == 20 &&
+                     vertices.get_z()[1] == 0.25 && vertices.get_x()[2] == 4 && vertices.get_y()[3] == 8 &&
+                     vertices.get_z()[3] == 0;
+
+  Mesh faces = parse("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 0 0 1\n"
+                     "f 1 2 3\n"
+                     "f 1/1 2/2 3/3\n"
+                     "f 1//4 3//4 4//4\n"
+                     "f 1/2/3 2/3/4 5/1/1 # comment\n"
+                     "f -5 -4 -1\n"
+                     "f 1 2 3 4 5\n");
+  bool triangles = faces.face_count() == 8 && has_face(faces, 0, 0, 1, 2) && has_face(faces, 1, 0, 1, 2) &&
+                   has_face(faces, 2, 0, 2, 3) && has_face(faces, 3, 0, 1, 4) && has_face(faces, 4, 0, 1, 4);
+  bool fan = has_face(faces, 5, 0, 1, 2) && has_face(faces, 6, 0, 2, 3) && has_face(faces, 7, 0, 3, 4);
+
+  Mesh bad = parse("v 0 0 0\nv 1 0 0\nv 1 1 0\n"
+                   "f 1 2\n"
+                   "f 1 2 4\n"
+                   "f 0 1 2\n"
+                   "f 1 2 -4\n"
+                   "f 1 2 3 x\n"
+                   "f 1 2 3\n");
+  bool left_out = bad.face_count() == 1 && has_face(bad, 0, 0, 1, 2);
+
+  // a second file added to a mesh refers to its own vertices
+  Mesh two = parse("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 3\n");
+  std::string second = "v 0 0 1\nv 1 0 1\nv 1 1 1\nf 3 2 1\n";
+  parse_obj(second.data(), second.data() + second.size(), two);
+  bool appended = two.vertex_count() == 6 && two.face_count() == 2 && has_face(two, 1, 5, 4, 3);
+
+  TestVector tests{
+      {"vertex lines", coordinates},
+      {"face lines", triangles},
+      {"polygons are split in triangles", fan},
+      {"faces with a vertex missing are left out", left_out},
+      {"several files in a mesh", appended}};
+
+  return run_tests("parse_obj", tests);
+}
+
+int test_load_obj()
+{
+  Mesh teapot;
+  bool loaded = load_obj("assets/teapot.obj", teapot);
+  Mesh none;
+  bool missing = !load_obj("assets/no_such_file.obj", none) && none.vertex_count() == 0;
+
+  TestVector tests{
+      {"teapot loaded", loaded && teapot.vertex_count() == 530 && teapot.face_count() == 1024},
+      {"teapot vertex", teapot.vertex_count() > 0 && teapot.get_x()[0] == 40.6266 && teapot.get_z()[0] == -1.10804},
+      {"missing file", missing}};
+
+  return run_tests("load_obj", tests);
+}
+
+int main()
+{
+  int failures{0};
+
+  failures += test_parse_real();
+  failures += test_parse_obj();
+  failures += test_load_obj();
+
+  if (failures > 0)
+  {
+    std::cout << "Total failures : " << failures << std::endl;
+    std::cout << "THE TEST FAILED!!" << std::endl;
+    return 1;
+  }
+  else
+  {
+    std::cout << "Success!" << std::endl;
+    return 0;
+  }
+}
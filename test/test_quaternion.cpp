@@ -0,0 +1,146 @@
+//
+// File       : test_quaternion.cpp
+// Licence    : see LICENCE
+// Maintainer : <your name here>
+//
+// Tests Quaternion class from aline library.
+//
+
+#include <vector> // std::vector
+#include "unit_test.h"
+#include "quaternion.h"
+
+using namespace aline;
+
+// Tests if two matrices are equal up to rounding errors (absolute tolerance, since
+// rotation matrices contain zeros).
+template <int N>
+bool close(const Matrix<real, N, N> &a, const Matrix<real, N, N> &b)
+{
+  for (int i = 0; i < N; ++i)
+    for (int j = 0; j < N; ++j)
+      if (fabs(a[i][j] - b[i][j]) > 1e-9)
+        return false;
+  return true;
+}
+
+bool close(const Quaternion &p, const Quaternion &q)
+{
+  return fabs(p.w - q.w) < 1e-9 && fabs(p.x - q.x) < 1e-9 && fabs(p.y - q.y) < 1e-9 && fabs(p.z - q.z) < 1e-9;
+}
+
+// The rotation matrices around each axis.
+Mat33r rotation_x(real a)
+{
+  return Mat33r({{1, 0, 0}, {0, cos(a), -sin(a)}, {0, sin(a), cos(a)}});
+}
+
+Mat33r rotation_y(real a)
+{
+  return Mat33r({{cos(a), 0, sin(a)}, {0, 1, 0}, {-sin(a), 0, cos(a)}});
+}
+
+Mat33r rotation_z(real a)
+{
+  return Mat33r({{cos(a), -sin(a), 0}, {sin(a), cos(a), 0}, {0, 0, 1}});
+}
+
+int test_constructors()
+{
+  Quaternion id;
+  Quaternion q(1, 2, 3, 4);
+  Quaternion rz = Quaternion::from_axis_angle({0, 0, 1}, M_PI / 2);
+
+  TestVector test_vec{
+      {"Quaternion() is the identity", id.w == 1 && id.x == 0 && id.y == 0 && id.z == 0},
+      {"Quaternion( w, x, y, z )", q.w == 1 && q.x == 2 && q.y == 3 && q.z == 4},
+      {"from_axis_angle( z, pi/2 )", close(rz, Quaternion(sqrt(0.5), 0, 0, sqrt(0.5)))},
+      {"from_euler_angles( a, b, c ) == Rz * Ry * Rx",
+       close(to_matrix33(Quaternion::from_euler_angles(0.3, -1.1, 2.5)), rotation_z(2.5) * rotation_y(-1.1) * rotation_x(0.3))}};
+
+  return run_tests("Quaternion constructors", test_vec);
+}
+
+int test_operators()
+{
+  Quaternion i(0, 1, 0, 0), j(0, 0, 1, 0), k(0, 0, 0, 1);
+  Quaternion p = Quaternion::from_axis_angle({1, 0, 0}, 0.7);
+  Quaternion q = Quaternion::from_axis_angle(unit_vector(Vec3r{1, -2, 0.5}), -1.3);
+
+  TestVector test_vec{
+      {"i * j == k", close(i * j, k)},
+      {"j * i == -k", close(j * i, Quaternion(0, 0, 0, -1))},
+      {"i * i == -1", close(i * i, Quaternion(-1, 0, 0, 0))},
+      {"q * conjugate( q ) == identity", close(q * conjugate(q), Quaternion())},
+      {"norm( q ) == 1", fabs(norm(q) - 1) < 1e-12},
+      {"norm( normalize( q ) ) == 1", fabs(norm(normalize(Quaternion(1, 2, 3, 4))) - 1) < 1e-12},
+      {"matrix( p * q ) == matrix( p ) * matrix( q )", close(to_matrix33(p * q), to_matrix33(p) * to_matrix33(q))},
+      {"matrix( conjugate( q ) ) == transpose( matrix( q ) )", close(to_matrix33(conjugate(q)), transpose(to_matrix33(q)))}};
+
+  return run_tests("Quaternion operators", test_vec);
+}
+
+int test_to_matrix()
+{
+  Quaternion q = Quaternion::from_axis_angle(unit_vector(Vec3r{2, 1, -1}), 2.1);
+  Mat33r r = to_matrix33(q);
+  Mat44r h = to_matrix44(q);
+  Vec3r v{0.5, -3, 2};
+
+  bool same_part = true;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      same_part = same_part && h[i][j] == r[i][j];
+
+  TestVector test_vec{
+      {"to_matrix33( x rotation )", close(to_matrix33(Quaternion::from_axis_angle({1, 0, 0}, 0.4)), rotation_x(0.4))},
+      {"to_matrix33( y rotation )", close(to_matrix33(Quaternion::from_axis_angle({0, 1, 0}, 0.4)), rotation_y(0.4))},
+      {"to_matrix33( z rotation )", close(to_matrix33(Quaternion::from_axis_angle({0, 0, 1}, 0.4)), rotation_z(0.4))},
+      {"to_matrix33( q ) is orthonormal", close(r * transpose(r), Mat33r({{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}))},
+      {"to_matrix33( q ) keeps norms", fabs(norm(r * v) - norm(v)) < 1e-12},
+      {"rotate( q, v ) == to_matrix33( q ) * v", nearly_equal(rotate(q, v), r * v)},
+      {"to_matrix44( q ) contains to_matrix33( q )", same_part},
+      {"to_matrix44( q ) is homogeneous", h[3][3] == 1 && h[0][3] == 0 && h[3][0] == 0 && h[3][1] == 0 && h[3][2] == 0}};
+
+  return run_tests("to_matrix33/44( Quaternion )", test_vec);
+}
+
+int test_slerp()
+{
+  Vec3r axis = unit_vector(Vec3r{0, 1, 1});
+  Quaternion p = Quaternion::from_axis_angle(axis, 0.2);
+  Quaternion q = Quaternion::from_axis_angle(axis, 1.4);
+  Quaternion minus_q(-q.w, -q.x, -q.y, -q.z);
+  Quaternion r = Quaternion::from_axis_angle(axis, 0.2 + 1e-5);
+
+  TestVector test_vec{
+      {"slerp( p, q, 0 ) == p", close(slerp(p, q, 0), p)},
+      {"slerp( p, q, 1 ) == q", close(slerp(p, q, 1), q)},
+      {"slerp( p, q, 0.25 ) at constant speed", close(slerp(p, q, 0.25), Quaternion::from_axis_angle(axis, 0.5))},
+      {"slerp( p, -q, 0.5 ) takes the shortest path", close(slerp(p, minus_q, 0.5), Quaternion::from_axis_angle(axis, 0.8))},
+      {"slerp( p, nearly p, 0.5 ) is a unit quaternion", fabs(norm(slerp(p, r, 0.5)) - 1) < 1e-12}};
+
+  return run_tests("slerp( Quaternion, Quaternion, t )", test_vec);
+}
+
+int main()
+{
+  int failures{0};
+
+  failures += test_constructors();
+  failures += test_operators();
+  failures += test_to_matrix();
+  failures += test_slerp();
+
+  if (failures > 0)
+  {
+    std::cout << "Total failures : " << failures << std::endl;
+    std::cout << "THE TEST FAILED!!" << std::endl;
+    return 1;
+  }
+  else
+  {
+    std::cout << "Success!" << std::endl;
+    return 0;
+  }
+}
@@ -0,0 +1,914 @@
+//
+// File       : test_render.cpp
+// Licence    : see LICENCE
+// Maintainer : Maxence BOISÉDU
+//
+// Tests the rendering pipeline of Scene on a MemoryTarget (no display needed).
+//
+
+#include <atomic>  // std::atomic
+#include <cstdlib> // std::malloc, std::free
+#include <new>     // std::bad_alloc
+#include "unit_test.h"
+#include "scene.h"
+
+// Counts heap allocations, to check the steady state of the pipeline. (The replacements
+// are not inlined, otherwise g++ sees malloc paired with delete. The scene threads
+// allocate too, while they grow their buffers.)
+static std::atomic<size_t> allocations(0);
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+  ++allocations;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+// A tetrahedron, small enough to be seen entirely.
+Shape tetrahedron()
+{
+  std::vector<Vertex> verts{
+      Vertex({-1.0, -1.0, -1.0}, 1.0),
+      Vertex({1.0, -1.0, -1.0}, 1.0),
+      Vertex({0.0, 1.0, -1.0}, 1.0),
+      Vertex({0.0, 0.0, 1.0}, 1.0)};
+  std::vector<Face> faces{
+      Face(0, 2, 1, minwin::GREEN),
+      Face(0, 1, 3, minwin::BLUE),
+      Face(1, 2, 3, minwin::RED),
+      Face(2, 0, 3, minwin::YELLOW)};
+  return Shape("tetrahedron", verts, faces);
+}
+
+// Number of pixels of an image which are not the background.
+size_t drawn_pixels(const FrameBuffer &fb)
+{
+  size_t n = 0;
+  for (int i = 0; i < fb.get_width() * fb.get_height(); ++i)
+    n += fb.data()[i] != pack_color(minwin::BLACK);
+  return n;
+}
+
+// Number of pixels of an image with the given color.
+size_t pixels_of_color(const FrameBuffer &fb, const minwin::Color &color)
+{
+  size_t n = 0;
+  for (int i = 0; i < fb.get_width() * fb.get_height(); ++i)
+    n += fb.data()[i] == pack_color(color);
+  return n;
+}
+
+// Whether two images have the same size and pixels.
+bool same_pixels(const FrameBuffer &a, const FrameBuffer &b)
+{
+  return a.get_width() == b.get_width() && a.get_height() == b.get_height() &&
+         std::equal(a.data(), a.data() + a.get_width() * a.get_height(), b.data());
+}
+
+// The two overlapping tetrahedra of the rendering tests, over several tiles (or only the
+// first one).
+std::vector<Object> overlapping_tetrahedra(const Shape &shape, size_t count = 2)
+{
+  std::vector<Object> objects{Object(&shape, {0.0, 0.0, 100.0}, {20.0, 30.0, 0.0}, {1.0, 1.0, 1.0}),
+                              Object(&shape, {0.5, 0.3, 90.0}, {-10.0, 60.0, 5.0}, {1.0, 1.0, 1.0})};
+  objects.resize(std::min(count, objects.size()), objects[0]);
+  return objects;
+}
+
+// Settings of a scene rendered by render(): by default, the objects are drawn in solid
+// mode in one buffered frame, with the default threads, on a new MemoryTarget.
+struct RenderSettings
+{
+  std::vector<Object> objects;
+  DrawMode draw_mode;
+  FillMode fill_mode;
+  PresentMode present_mode;
+  unsigned thread_count;     // (0 for the default)
+  unsigned frames_in_flight; // (0 for the default)
+  bool moving;               // whether the camera moves forward (the key A is held)
+  uint frames;
+  MemoryTarget *target; // (nullptr for a new one)
+
+  explicit RenderSettings(const std::vector<Object> &objects)
+      : objects(objects), draw_mode(solid), fill_mode(edge_function), present_mode(buffered), thread_count(0),
+        frames_in_flight(0), moving(false), frames(1), target(nullptr)
+  {
+  }
+};
+
+// Renders a scene with the given settings and returns the pixels of its target. The stats
+// of the last frame and the number of frames go in stats and frame_count, if not null.
+FrameBuffer render(const RenderSettings &settings, FrameStats *stats = nullptr, uint *frame_count = nullptr)
+{
+  MemoryTarget own_target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  MemoryTarget &target = settings.target != nullptr ? *settings.target : own_target;
+  Scene scene(&target);
+  scene.initialise();
+  scene.set_draw_mode(settings.draw_mode);
+  scene.set_fill_mode(settings.fill_mode);
+  scene.set_present_mode(settings.present_mode);
+  if (settings.thread_count > 0)
+    scene.set_thread_count(settings.thread_count);
+  if (settings.frames_in_flight > 0)
+    scene.set_max_frames_in_flight(settings.frames_in_flight);
+  for (const Object &o : settings.objects)
+    scene.add_object(o);
+  if (settings.moving)
+    target.press_key(minwin::KEY_A);
+  scene.run(settings.frames);
+  if (stats != nullptr)
+    *stats = scene.get_stats();
+  if (frame_count != nullptr)
+    *frame_count = scene.get_frame_count();
+  return target.get_pixels();
+}
+
+// A target which can't take framebuffers, as a window whose texture could not be created.
+class NoBufferTarget : public MemoryTarget
+{
+public:
+  int buffers; // calls of put_buffer()
+
+  NoBufferTarget(int width, int height) : MemoryTarget(width, height), buffers(0)
+  {
+  }
+
+  bool put_buffer(const FrameBuffer &, int, int)
+  {
+    ++buffers;
+    return false;
+  }
+};
+
+int test_buffer_fallback()
+{
+  Shape shape = tetrahedron();
+  NoBufferTarget target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  RenderSettings settings(overlapping_tetrahedra(shape, 1));
+  settings.frames = 6;
+  settings.target = &target;
+  FrameBuffer image = render(settings);
+
+  // (the frame in flight, if any, was prepared before the first one failed)
+  TestVector test_vec{
+      {"falls back to per pixel drawing", target.buffers >= 1 && target.buffers <= 2},
+      {"triangles are drawn on the target", drawn_pixels(image) > 1000}};
+
+  return run_tests("Framebuffer fallback", test_vec);
+}
+
+int test_mesh_views()
+{
+  Shape shape = tetrahedron();
+  Object o(&shape, {0.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0});
+
+  TestVector test_vec{
+      {"&o.get_mesh() == &shape.get_mesh()", &o.get_mesh() == &shape.get_mesh()},
+      {"&o.get_shape() == &shape", &o.get_shape() == &shape}};
+
+  return run_tests("Object mesh views", test_vec);
+}
+
+int test_mesh_layout()
+{
+  Shape shape = tetrahedron();
+  const Mesh &mesh = shape.get_mesh();
+
+  TestVector test_vec{
+      {"mesh.vertex_count() == 4", mesh.vertex_count() == 4},
+      {"mesh.face_count() == 4", mesh.face_count() == 4},
+      {"mesh.get_indices().size() == 12", mesh.get_indices().size() == 12},
+      {"x aligned", (uintptr_t)mesh.get_x().data() % MESH_ALIGNMENT == 0},
+      {"y aligned", (uintptr_t)mesh.get_y().data() % MESH_ALIGNMENT == 0},
+      {"z aligned", (uintptr_t)mesh.get_z().data() % MESH_ALIGNMENT == 0},
+      {"mesh.get_vertex( 2 ) == Vec3r{0,1,-1}", mesh.get_vertex(2) == aline::Vec3r({0.0, 1.0, -1.0})},
+      {"face 1 == (0,1,3)", mesh.get_indices()[3] == 0 && mesh.get_indices()[4] == 1 && mesh.get_indices()[5] == 3},
+      {"face 2 is red", mesh.get_colors()[2] == minwin::RED}};
+
+  return run_tests("Mesh layout", test_vec);
+}
+
+int test_steady_state_allocations()
+{
+  Shape shape = tetrahedron();
+  MemoryTarget target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Scene scene(&target);
+  scene.initialise();
+  scene.add_object(Object(&shape, {0.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+
+  // the first frames (one per frame in flight) size the per-frame buffers and start the
+  // geometry thread
+  unsigned warm_up = scene.get_max_frames_in_flight();
+  scene.run(warm_up);
+  size_t before = allocations;
+  scene.run(10);
+  size_t wireframe_allocations = allocations - before;
+
+  scene.change_draw_mode();
+  scene.run(warm_up);
+  before = allocations;
+  scene.run(10);
+  size_t solid_allocations = allocations - before;
+
+  TestVector test_vec{
+      {"wireframe frames allocate nothing", wireframe_allocations == 0},
+      {"solid frames allocate nothing", solid_allocations == 0},
+      {"10 frames drawn", scene.get_frame_count() == 10}};
+
+  return run_tests("Steady state allocations", test_vec);
+}
+
+int test_transform_caching()
+{
+  Shape shape = tetrahedron();
+  MemoryTarget target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Scene scene(&target);
+  scene.initialise();
+  scene.add_object(Object(&shape, {0.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  scene.add_object(Object(&shape, {1.5, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+
+  // first frame: the camera and both objects are new
+  scene.run(1);
+  FrameStats first = scene.get_stats();
+
+  // nothing moves
+  scene.run(1);
+  FrameStats still = scene.get_stats();
+  FrameBuffer still_image = scene.get_framebuffer();
+
+  // only the second object moves
+  scene.get_object(1).set_translation({-1.5, 0.5, 100.0});
+  scene.run(1);
+  FrameStats moved = scene.get_stats();
+  std::vector<size_t> changed = scene.get_changed_objects();
+  FrameBuffer moved_image = scene.get_framebuffer();
+
+  // same picture from a scene built directly with the second object there
+  MemoryTarget fresh_target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Scene fresh(&fresh_target);
+  fresh.initialise();
+  fresh.add_object(Object(&shape, {0.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  fresh.add_object(Object(&shape, {-1.5, 0.5, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  fresh.run(1);
+
+  bool same_image = same_pixels(moved_image, fresh.get_framebuffer());
+  bool image_changed = !same_pixels(still_image, moved_image);
+
+  TestVector test_vec{
+      {"first frame builds 3 matrices", first.matrix_builds == 3},
+      {"first frame transforms every vertex", first.changed_objects == 2 && first.vertex_transforms == 8},
+      {"static frame builds no matrix", still.matrix_builds == 0},
+      {"static frame transforms no vertex", still.changed_objects == 0 && still.vertex_transforms == 0},
+      {"moved object is the only one rebuilt", moved.matrix_builds == 1 && changed.size() == 1 && changed[0] == 1},
+      {"moved object is the only one transformed", moved.vertex_transforms == 4},
+      {"moved object changes the image", image_changed},
+      {"moved object is drawn at its new place", same_image}};
+
+  return run_tests("Transform caching", test_vec);
+}
+
+int test_camera_roll()
+{
+  Shape shape = tetrahedron();
+  MemoryTarget target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Scene scene(&target);
+  scene.initialise();
+  scene.add_object(Object(&shape, {10.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+
+  // out of sight, until the camera moves in front of it
+  scene.run(1);
+  bool hidden_at_first = drawn_pixels(scene.get_framebuffer()) == 0;
+  target.press_key(minwin::KEY_Q);
+  scene.run(20);
+  target.release_key(minwin::KEY_Q);
+  size_t in_front = drawn_pixels(scene.get_framebuffer());
+
+  // rolling around the camera's own axis keeps the object in sight
+  bool always_visible = true;
+  target.press_key(minwin::KEY_L);
+  for (int i = 0; i < 180; ++i)
+  {
+    scene.run(1);
+    always_visible = always_visible && drawn_pixels(scene.get_framebuffer()) > 0;
+  }
+  target.release_key(minwin::KEY_L);
+
+  TestVector test_vec{
+      {"object hidden before moving", hidden_at_first},
+      {"object visible after moving", in_front > 0},
+      {"object visible while rolling", always_visible}};
+
+  return run_tests("Camera roll", test_vec);
+}
+
+int test_fill_modes()
+{
+  Shape shape = tetrahedron();
+  RenderSettings settings(overlapping_tetrahedra(shape, 1));
+  settings.fill_mode = scanline;
+  FrameBuffer scanline_image = render(settings);
+  settings.fill_mode = edge_function;
+  FrameBuffer edge_image = render(settings);
+
+  // both rasterizers cover the same pixels, up to rounding on the edges (which are
+  // mostly covered by the outlines), but only the edge function one hides faces
+  uint32_t black = pack_color(minwin::BLACK);
+  size_t drawn = drawn_pixels(edge_image), different = 0;
+  for (int i = 0; i < edge_image.get_width() * edge_image.get_height(); ++i)
+    different += (edge_image.data()[i] != black) != (scanline_image.data()[i] != black);
+
+  MemoryTarget default_target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  TestVector test_vec{
+      {"edge function is the default", Scene(&default_target).get_fill_mode() == edge_function},
+      {"triangles are drawn", drawn > 1000},
+      {"same pixels as the scanline rasterizer", different * 100 < drawn}};
+
+  return run_tests("Fill modes", test_vec);
+}
+
+int test_tiled_rasterizer()
+{
+  Shape shape = tetrahedron();
+  std::vector<FrameBuffer> images;
+  // per pixel (drawn directly, in one thread), then tiled with 1, 2 and 5 threads
+  unsigned thread_counts[] = {0, 1, 2, 5};
+  for (unsigned threads : thread_counts)
+  {
+    RenderSettings settings(overlapping_tetrahedra(shape));
+    if (threads == 0)
+      settings.present_mode = per_pixel;
+    settings.thread_count = threads;
+    images.push_back(render(settings));
+  }
+
+  TestVector test_vec{
+      {"triangles are drawn", drawn_pixels(images[0]) > 1000},
+      {"1 thread draws the same image", same_pixels(images[1], images[0])},
+      {"2 threads draw the same image", same_pixels(images[2], images[0])},
+      {"5 threads draw the same image", same_pixels(images[3], images[0])}};
+
+  return run_tests("Tiled rasterizer", test_vec);
+}
+
+int test_depth_buffer()
+{
+  Shape shape = tetrahedron();
+  std::vector<FrameBuffer> images;
+  // the same overlapping objects, added in both orders
+  for (int order = 0; order < 2; ++order)
+  {
+    MemoryTarget target(WINDOW_WIDTH, WINDOW_HEIGHT);
+    Scene scene(&target);
+    scene.initialise();
+    scene.change_draw_mode();
+    Object near(&shape, {0.3, 0.0, 95.0}, {20.0, 30.0, 0.0}, {1.0, 1.0, 1.0});
+    Object far(&shape, {0.0, 0.2, 100.0}, {-10.0, 60.0, 5.0}, {1.0, 1.0, 1.0});
+    scene.add_object(order == 0 ? near : far);
+    scene.add_object(order == 0 ? far : near);
+    scene.run(1);
+    images.push_back(scene.get_framebuffer());
+  }
+  // (outlines are drawn over the fills of the previous objects, so only compare fills)
+  uint32_t black = pack_color(minwin::BLACK);
+  bool same_fills = true;
+  for (int i = 0; i < images[0].get_width() * images[0].get_height(); ++i)
+  {
+    uint32_t a = images[0].data()[i], b = images[1].data()[i];
+    same_fills = same_fills && (a == black || b == black || a == b);
+  }
+
+  // a triangle 2 units away, with its apex 4 units away: 1/z is interpolated linearly
+  auto pixel = [](int x, int y)
+  { return aline::Vec2i{x * RASTER_SUBPIXEL, y * RASTER_SUBPIXEL}; };
+  DepthBuffer depth(128, 128);
+  size_t drawn = 0;
+  auto count = [&](int, int, int n)
+  { drawn += n; };
+  PixelRect all{0, 0, 127, 127};
+  fill_triangle(pixel(0, 0), pixel(127, 0), pixel(0, 127), 0.5f, 0.5f, 0.25f, all, depth, count);
+  size_t near_drawn = drawn;
+  bool perspective_correct = fabs(depth.get_depth(0, 64) - (0.5f + 0.25f) / 2) < 1e-3;
+
+  // a farther triangle over it is rejected by the hierarchical Z, a nearer one is drawn
+  drawn = 0;
+  fill_triangle(pixel(0, 0), pixel(60, 0), pixel(0, 60), 0.2f, 0.2f, 0.2f, all, depth, count);
+  size_t far_drawn = drawn;
+  bool tile_known = depth.tile_farthest(0, 0) >= 0.25f;
+  drawn = 0;
+  fill_triangle(pixel(0, 0), pixel(60, 0), pixel(0, 60), 1.0f, 1.0f, 1.0f, all, depth, count);
+  size_t nearer_drawn = drawn;
+
+  TestVector test_vec{
+      {"drawing order does not matter", same_fills},
+      {"triangle drawn", near_drawn > 8000},
+      {"depth is perspective correct", perspective_correct},
+      {"hierarchical Z knows the first tile is covered", tile_known},
+      {"farther triangle hidden", far_drawn == 0},
+      {"nearer triangle drawn", nearer_drawn > 1800}};
+
+  return run_tests("Depth buffer", test_vec);
+}
+
+int test_backface_culling()
+{
+  Shape shape = tetrahedron();
+  // seen from the camera, only the green face (the base) is a front face
+  CullMode modes[] = {cull_back, cull_front, cull_none};
+  std::vector<FrameBuffer> images;
+  std::vector<uint> culled;
+  for (CullMode mode : modes)
+  {
+    MemoryTarget target(WINDOW_WIDTH, WINDOW_HEIGHT);
+    Scene scene(&target);
+    scene.initialise();
+    scene.change_draw_mode();
+    scene.add_object(Object(&shape, {0.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+    scene.get_object(0).set_cull_mode(mode);
+    scene.run(1);
+    images.push_back(scene.get_framebuffer());
+    culled.push_back(scene.get_stats().culled_triangles);
+  }
+  size_t back_faces_drawn = pixels_of_color(images[0], minwin::BLUE) + pixels_of_color(images[0], minwin::RED) +
+                            pixels_of_color(images[0], minwin::YELLOW);
+
+  TestVector test_vec{
+      {"back faces culled by default", Object(&shape, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}).get_cull_mode() == cull_back},
+      {"cull_back culls 3 faces", culled[0] == 3},
+      {"cull_front culls 1 face", culled[1] == 1},
+      {"cull_none culls nothing", culled[2] == 0},
+      {"cull_back draws the front face", pixels_of_color(images[0], minwin::GREEN) > 1000},
+      {"cull_back draws no back face", back_faces_drawn == 0},
+      {"cull_front hides the front face", pixels_of_color(images[1], minwin::GREEN) == 0},
+      {"cull_none draws the front face", pixels_of_color(images[2], minwin::GREEN) > 1000}};
+
+  return run_tests("Back-face culling", test_vec);
+}
+
+int test_frustum_culling()
+{
+  Shape shape = tetrahedron();
+  MemoryTarget target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Scene scene(&target);
+  scene.initialise();
+  scene.add_object(Object(&shape, {0.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  // on the side, behind the camera and across the edge of the view
+  scene.add_object(Object(&shape, {10.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  scene.add_object(Object(&shape, {0.0, 0.0, -100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  scene.add_object(Object(&shape, {0.0, 2.5, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  scene.run(1);
+  FrameStats culled = scene.get_stats();
+  FrameBuffer image = scene.get_framebuffer();
+
+  MemoryTarget visible_target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Scene visible(&visible_target);
+  visible.initialise();
+  visible.add_object(Object(&shape, {0.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  visible.add_object(Object(&shape, {0.0, 2.5, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  visible.run(1);
+  bool same_image = same_pixels(image, visible.get_framebuffer());
+
+  // an object moving into the view is drawn
+  scene.get_object(1).set_translation({0.0, -1.5, 100.0});
+  scene.run(1);
+  FrameStats moved = scene.get_stats();
+
+  // the bounds of a shape
+  const Bounds &b = shape.get_bounds();
+
+  TestVector test_vec{
+      {"shape box", b.center == aline::Vec3r({0.0, 0.0, 0.0}) && b.half_extents == aline::Vec3r({1.0, 1.0, 1.0})},
+      {"shape sphere", fabs(b.radius - sqrt(3.0)) < 1e-12},
+      {"objects out of view culled", culled.culled_objects == 2},
+      {"objects out of view not transformed", culled.vertex_transforms == 8},
+      {"objects in view drawn", same_image && drawn_pixels(image) > 0},
+      {"object moved into view transformed", moved.culled_objects == 1 && moved.vertex_transforms == 4}};
+
+  return run_tests("Frustum culling", test_vec);
+}
+
+int test_clipping()
+{
+  // a triangle with a vertex behind the camera, in clip coordinates
+  aline::Vec4r face[3] = {{0.0, 0.0, 1.0, 2.0}, {1.0, 0.0, 1.0, 2.0}, {0.0, 1.0, 1.0, -1.0}};
+  aline::Vec4r polygon[CLIP_MAX_VERTICES];
+  int n = clip_triangle(face, polygon);
+  bool in_front = true;
+  for (int i = 0; i < n; ++i)
+    in_front = in_front && polygon[i][3] >= 1 - 1e-12;
+
+  // the camera inside an object, seen from the inside (its base is behind the camera)
+  Shape shape = tetrahedron();
+  MemoryTarget target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Scene scene(&target);
+  scene.initialise();
+  scene.change_draw_mode();
+  scene.add_object(Object(&shape, {0.0, 0.0, 0.5}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}));
+  scene.get_object(0).set_cull_mode(cull_none);
+  scene.run(1);
+  FrameStats inside = scene.get_stats();
+  size_t inside_drawn = drawn_pixels(scene.get_framebuffer());
+
+  // a face much larger than the view, in front of the camera (the others face away)
+  scene.get_object(0).set_translation({0.0, 0.0, 3.0});
+  scene.get_object(0).set_cull_mode(cull_back);
+  scene.run(1);
+  FrameStats large = scene.get_stats();
+  size_t large_drawn = pixels_of_color(scene.get_framebuffer(), minwin::GREEN);
+
+  TestVector test_vec{
+      {"clipped triangle is a quad", n == 4},
+      {"clipped triangle is behind the near plane", in_front},
+      {"faces across the near plane clipped", inside.clipped_triangles == 3 && inside.rejected_triangles == 1},
+      {"inside of the object drawn", inside_drawn > CANVAS_DIM * CANVAS_DIM * 9 / 10},
+      {"face out of the guard band clipped", large.clipped_triangles >= 1},
+      {"face larger than the view fills the canvas", large_drawn == CANVAS_DIM * CANVAS_DIM}};
+
+  return run_tests("Clipping", test_vec);
+}
+
+int test_line_clipping()
+{
+  // lines across, inside, along and outside of the rectangle, in every direction
+  PixelRect rect{10, 20, 109, 69};
+  PixelRect everywhere{-100000, -100000, 100000, 100000};
+  aline::Vec2i lines[][2] = {{{0, 0}, {150, 90}}, {{150, 90}, {0, 0}}, {{-3, 75}, {120, 11}}, {{30, 30}, {40, 60}},
+                             {{60, -500}, {61, 500}}, {{-800, 45}, {900, 45}}, {{50, 0}, {50, 200}}, {{0, 0}, {5, 200}},
+                             {{200, 0}, {300, 300}}, {{-90000, -70000}, {90000, 80000}}, {{12, 22}, {12, 22}}};
+
+  bool same_line_pixels = true;
+  size_t visible = 0;
+  for (auto &l : lines)
+  {
+    std::vector<std::pair<int, int>> clipped, filtered;
+    draw_line(l[0], l[1], rect, [&](int x, int y)
+              { clipped.push_back({x, y}); });
+    draw_line(l[0], l[1], everywhere, [&](int x, int y)
+              {
+                if (x >= rect.min_x && x <= rect.max_x && y >= rect.min_y && y <= rect.max_y)
+                  filtered.push_back({x, y}); });
+    std::sort(clipped.begin(), clipped.end());
+    std::sort(filtered.begin(), filtered.end());
+    same_line_pixels = same_line_pixels && clipped == filtered;
+    visible += clipped.size();
+  }
+
+  TestVector test_vec{
+      {"clipped lines have the pixels of the whole lines", same_line_pixels},
+      {"lines are drawn", visible > 300}};
+
+  return run_tests("Line clipping", test_vec);
+}
+
+int test_edge_buffer()
+{
+  Shape shape = tetrahedron();
+  const std::vector<uint32_t> &edges = shape.get_edges();
+  const std::vector<uint32_t> &face_edges = shape.get_face_edges();
+  const std::vector<uint32_t> &indices = shape.get_mesh().get_indices();
+
+  // each side of a face is the edge between its two vertices
+  bool sides = face_edges.size() == 12;
+  for (size_t f = 0; f < 4 && sides; ++f)
+    for (int k = 0; k < 3; ++k)
+    {
+      uint32_t a = indices[3 * f + k], b = indices[3 * f + (k + 1) % 3];
+      uint32_t e = face_edges[3 * f + k];
+      sides = sides && e < shape.edge_count() && edges[2 * e] == std::min(a, b) && edges[2 * e + 1] == std::max(a, b);
+    }
+
+  // lines drawn in wireframe mode, per pixel and tiled
+  CullMode modes[] = {cull_back, cull_none};
+  PresentMode present_modes[] = {per_pixel, buffered};
+  std::vector<uint> lines;
+  std::vector<FrameBuffer> images;
+  for (CullMode mode : modes)
+    for (PresentMode present : present_modes)
+    {
+      RenderSettings settings(overlapping_tetrahedra(shape, 1));
+      settings.objects[0].set_cull_mode(mode);
+      settings.draw_mode = wireframe;
+      settings.present_mode = present;
+      FrameStats stats;
+      images.push_back(render(settings, &stats));
+      lines.push_back(stats.drawn_lines);
+    }
+
+  // a face across the near plane, clipped into a quad (a fan of 2 triangles): only the
+  // sides of the quad are drawn, per pixel and tiled
+  Shape across("face across the near plane",
+               {Vertex({-0.3, -0.3, 1.0}, 1.0), Vertex({0.3, -0.3, 1.0}, 1.0), Vertex({0.0, 0.3, -1.0}, 1.0)},
+               {Face(0, 1, 2, minwin::GREEN)});
+  bool quad_sides = true;
+  for (PresentMode present : present_modes)
+  {
+    RenderSettings settings({Object(&across, {0.0, 0.0, 1.5}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0})});
+    settings.objects[0].set_cull_mode(cull_none);
+    settings.draw_mode = wireframe;
+    settings.present_mode = present;
+    FrameStats stats;
+    render(settings, &stats);
+    quad_sides = quad_sides && stats.clipped_triangles == 1 && stats.drawn_lines == 4;
+  }
+
+  TestVector test_vec{
+      {"shape.edge_count() == 6", shape.edge_count() == 6 && edges.size() == 12},
+      {"faces sides are their edges", sides},
+      {"cull_none draws each edge once", lines[2] == 6 && lines[3] == 6},
+      {"cull_back draws the edges of the front faces", lines[0] > 0 && lines[0] < 6},
+      {"tiled and per pixel lines are the same", same_pixels(images[0], images[1]) && same_pixels(images[2], images[3])},
+      {"lines are drawn", drawn_pixels(images[2]) > 100},
+      {"a clipped face is outlined by its polygon", quad_sides}};
+
+  return run_tests("Edge buffer", test_vec);
+}
+
+int test_subpixel_rasterization()
+{
+  const int size = 100;
+  PixelRect all{0, 0, size - 1, size - 1};
+  DepthBuffer depth(size, size);
+  std::vector<int> counts(size * size, 0);
+  auto count = [&](int x, int y, int n)
+  {
+    for (int i = 0; i < n; ++i)
+      ++counts[y * size + x + i];
+  };
+  // (each triangle is drawn on an empty depth buffer, to count all its pixels)
+  auto fill = [&](const aline::Vec2i &p0, const aline::Vec2i &p1, const aline::Vec2i &p2)
+  {
+    depth.clear();
+    fill_triangle(p0, p1, p2, 0.5f, 0.5f, 0.5f, all, depth, count);
+  };
+
+  // a square of 4 x 4 pixels (corners on pixel centers) made of 2 triangles: the pixels on
+  // its top and left edges are inside, those on its bottom and right edges are not
+  const int s = RASTER_SUBPIXEL;
+  fill(aline::Vec2i{10 * s, 10 * s}, aline::Vec2i{14 * s, 10 * s}, aline::Vec2i{14 * s, 14 * s});
+  fill(aline::Vec2i{10 * s, 10 * s}, aline::Vec2i{14 * s, 14 * s}, aline::Vec2i{10 * s, 14 * s});
+  bool top_left = true;
+  for (int y = 9; y <= 15; ++y)
+    for (int x = 9; x <= 15; ++x)
+      top_left = top_left && counts[y * size + x] == (x >= 10 && x < 14 && y >= 10 && y < 14);
+
+  // a grid of triangles with vertices placed at random subpixel positions: every pixel
+  // inside is drawn exactly once, neither cracks nor overlaps
+  std::fill(counts.begin(), counts.end(), 0);
+  const int cells = 9, step = 10 * s;
+  aline::Vec2i grid[cells + 1][cells + 1];
+  srand(7);
+  for (int j = 0; j <= cells; ++j)
+    for (int i = 0; i <= cells; ++i)
+    {
+      bool border = i == 0 || j == 0 || i == cells || j == cells;
+      grid[j][i] = aline::Vec2i{5 * s + i * step + (border ? 0 : rand() % (step / 2) - step / 4),
+                                5 * s + j * step + (border ? 0 : rand() % (step / 2) - step / 4)};
+    }
+  for (int j = 0; j < cells; ++j)
+    for (int i = 0; i < cells; ++i)
+    {
+      fill(grid[j][i], grid[j][i + 1], grid[j + 1][i + 1]);
+      fill(grid[j][i], grid[j + 1][i + 1], grid[j + 1][i]);
+    }
+  bool once = true;
+  for (int y = 0; y < size; ++y)
+    for (int x = 0; x < size; ++x)
+      once = once && counts[y * size + x] == (x >= 5 && x < 95 && y >= 5 && y < 95);
+
+  // a triangle moved by half a pixel covers other pixels
+  std::fill(counts.begin(), counts.end(), 0);
+  fill(aline::Vec2i{20 * s, 20 * s}, aline::Vec2i{60 * s, 20 * s}, aline::Vec2i{20 * s, 60 * s});
+  std::vector<int> whole = counts;
+  std::fill(counts.begin(), counts.end(), 0);
+  fill(aline::Vec2i{20 * s + s / 2, 20 * s}, aline::Vec2i{60 * s + s / 2, 20 * s}, aline::Vec2i{20 * s + s / 2, 60 * s});
+
+  TestVector test_vec{
+      {"top-left fill rule", top_left},
+      {"shared edges drawn once", once},
+      {"subpixel vertices", counts != whole}};
+
+  return run_tests("Subpixel rasterization", test_vec);
+}
+
+int test_outlined_fill()
+{
+  const int size = 40;
+  PixelRect all{0, 0, size - 1, size - 1};
+  DepthBuffer depth(size, size);
+  std::vector<int> fills(size * size, 0), edges(size * size, 0);
+  auto fill = [&](const aline::Vec2i &p0, const aline::Vec2i &p1, const aline::Vec2i &p2, int outline)
+  {
+    depth.clear();
+    fill_triangle(p0, p1, p2, 0.5f, 0.5f, 0.5f, outline, all, depth,
+                  [&](int x, int y, int n)
+                  {
+                    for (int i = 0; i < n; ++i)
+                      ++fills[y * size + x + i];
+                  },
+                  [&](int x, int y, int n)
+                  {
+                    for (int i = 0; i < n; ++i)
+                      ++edges[y * size + x + i];
+                  });
+  };
+
+  // a square of 20 x 20 pixels made of 2 triangles, whose diagonal is shared
+  const int s = RASTER_SUBPIXEL;
+  aline::Vec2i a{10 * s, 10 * s}, b{30 * s, 10 * s}, c{30 * s, 30 * s}, d{10 * s, 30 * s};
+  fill(a, b, c, outline_sides | outline_shared2);
+  fill(a, c, d, outline_sides | outline_shared0);
+
+  bool once = true;
+  size_t square = 0;
+  for (int i = 0; i < size * size; ++i)
+  {
+    once = once && fills[i] + edges[i] <= 1;
+    square += fills[i] + edges[i];
+  }
+  // the rows across the square have a pixel of the left side, of the diagonal and of the
+  // right side
+  bool one_pixel_wide = true;
+  for (int y = 12; y < 28; ++y)
+    for (int x = 0; x < size; ++x)
+      one_pixel_wide = one_pixel_wide && edges[y * size + x] == (x == 10 || x == y || x == 29);
+  bool top_side = true;
+  for (int x = 10; x < 30; ++x)
+    top_side = top_side && edges[10 * size + x] == 1;
+
+  // without outline
+  std::fill(edges.begin(), edges.end(), 0);
+  fill(a, b, c, 0);
+  bool no_edge = std::count(edges.begin(), edges.end(), 0) == size * size;
+
+  TestVector test_vec{
+      {"pixels drawn once", once && square == 400},
+      {"edges are one pixel wide", one_pixel_wide},
+      {"top side outlined", top_side},
+      {"no outline, no edge", no_edge}};
+
+  return run_tests("Outlined fill", test_vec);
+}
+
+int test_solid_edges()
+{
+  Shape shape = tetrahedron();
+  // a large tetrahedron in front of a small one (only their bases are front faces)
+  Object front(&shape, {0.0, 0.0, 80.0}, {0.0, 0.0, 0.0}, {3.0, 3.0, 3.0});
+  Object back(&shape, {0.0, 0.0, 100.0}, {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0});
+
+  RenderSettings both({front, back}), front_only({front});
+  both.draw_mode = front_only.draw_mode = solid_edges;
+  FrameStats stats;
+  FrameBuffer edges_image = render(both, &stats);
+  FrameBuffer edges_front = render(front_only);
+  both.present_mode = per_pixel;
+  FrameBuffer edges_per_pixel = render(both);
+  both.present_mode = buffered;
+  both.draw_mode = front_only.draw_mode = solid;
+  FrameBuffer solid_image = render(both);
+  FrameBuffer solid_front = render(front_only);
+
+  // the outline of the front face: the black pixels with green ones on their right
+  uint32_t black = pack_color(minwin::BLACK), green = pack_color(minwin::GREEN);
+  size_t outline = 0;
+  for (int i = 0; i + 1 < edges_image.get_width() * edges_image.get_height(); ++i)
+    outline += edges_image.data()[i] == black && edges_image.data()[i + 1] == green;
+
+  TestVector test_vec{
+      {"no line drawn", stats.drawn_lines == 0},
+      {"faces are outlined", outline > 100},
+      {"hidden edges are not drawn", same_pixels(edges_image, edges_front)},
+      {"solid mode draws hidden edges", !same_pixels(solid_image, solid_front)},
+      {"tiled and per pixel are the same", same_pixels(edges_image, edges_per_pixel)}};
+
+  return run_tests("Solid with edges", test_vec);
+}
+
+int test_fill_span()
+{
+  // every start alignment and length, with each kernel: exactly the span is written
+  std::vector<uint32_t> buffer(64);
+  bool exact[3] = {true, true, true};
+  for (int level = aline::simd_scalar; level <= aline::simd_level(); ++level)
+    for (size_t start = 0; start < 9; ++start)
+      for (size_t n = 0; n < 40; ++n)
+      {
+        std::fill(buffer.begin(), buffer.end(), 0u);
+        fill_span(buffer.data() + start, n, 0xff00ff00u, (aline::SimdLevel)level);
+        for (size_t i = 0; i < buffer.size(); ++i)
+          exact[level] = exact[level] && buffer[i] == (i >= start && i < start + n ? 0xff00ff00u : 0u);
+      }
+
+  FrameBuffer fb(13, 3);
+  fb.clear(7);
+  fb.fill_span(2, 1, 9, 42);
+  bool row = fb.get_pixel(1, 1) == 7 && fb.get_pixel(2, 1) == 42 && fb.get_pixel(10, 1) == 42 &&
+             fb.get_pixel(11, 1) == 7 && fb.get_pixel(5, 0) == 7 && fb.get_pixel(5, 2) == 7;
+
+  TestVector test_vec{
+      {"scalar kernel", exact[aline::simd_scalar]},
+      {"sse2 kernel", exact[aline::simd_sse2]},
+      {"avx2 kernel", exact[aline::simd_avx2]},
+      {"FrameBuffer::fill_span( x, y, n, color )", row}};
+
+  return run_tests("Span fill", test_vec);
+}
+
+int test_pipelined_frames()
+{
+  Shape shape = tetrahedron();
+  std::vector<FrameBuffer> images;
+  std::vector<FrameStats> stats;
+  std::vector<uint> frame_counts;
+  // the camera moves towards the objects during the frames, each one being different
+  unsigned in_flight[] = {1, 2, 4};
+  for (unsigned frames : in_flight)
+  {
+    RenderSettings settings(overlapping_tetrahedra(shape));
+    settings.thread_count = 2;
+    settings.frames_in_flight = frames;
+    settings.moving = true;
+    settings.frames = 7;
+    FrameStats last;
+    uint count = 0;
+    images.push_back(render(settings, &last, &count));
+    stats.push_back(last);
+    frame_counts.push_back(count);
+  }
+
+  // a single frame, without the camera moving, is not the last one of the others
+  FrameBuffer still_image = render(RenderSettings(overlapping_tetrahedra(shape)));
+
+  // the frames in flight can be of several modes
+  MemoryTarget mixed_target(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Scene mixed(&mixed_target);
+  mixed.initialise();
+  mixed.set_max_frames_in_flight(3);
+  mixed.add_object(Object(&shape, {0.0, 0.0, 100.0}, {20.0, 30.0, 0.0}, {1.0, 1.0, 1.0}));
+  mixed.run(4);
+  mixed.set_present_mode(per_pixel);
+  mixed.run(2);
+  mixed.set_present_mode(buffered);
+  mixed.run(3);
+
+  mixed.set_max_frames_in_flight(100);
+  bool at_most = mixed.get_max_frames_in_flight() == MAX_FRAMES_IN_FLIGHT;
+  mixed.set_max_frames_in_flight(0);
+  bool at_least = mixed.get_max_frames_in_flight() == 1;
+
+  TestVector test_vec{
+      {"every frame is presented", frame_counts[0] == 7 && frame_counts[1] == 7 && frame_counts[2] == 7},
+      {"the camera moved", !same_pixels(images[0], still_image)},
+      {"2 frames in flight draw the same last frame", same_pixels(images[1], images[0])},
+      {"4 frames in flight draw the same last frame", same_pixels(images[2], images[0])},
+      {"the stats are those of the last frame", stats[1].drawn_lines == stats[0].drawn_lines &&
+                                                    stats[2].vertex_transforms == stats[0].vertex_transforms &&
+                                                    stats[0].vertex_transforms == 8},
+      {"frames of several modes", mixed.get_frame_count() == 3 && drawn_pixels(mixed_target.get_pixels()) > 0},
+      {"1 to MAX_FRAMES_IN_FLIGHT frames in flight", at_most && at_least}};
+
+  return run_tests("Pipelined frames", test_vec);
+}
+
+int main()
+{
+  int failures{0};
+
+  failures += test_buffer_fallback();
+  failures += test_mesh_views();
+  failures += test_mesh_layout();
+  failures += test_steady_state_allocations();
+  failures += test_transform_caching();
+  failures += test_camera_roll();
+  failures += test_fill_modes();
+  failures += test_tiled_rasterizer();
+  failures += test_depth_buffer();
+  failures += test_backface_culling();
+  failures += test_frustum_culling();
+  failures += test_clipping();
+  failures += test_line_clipping();
+  failures += test_subpixel_rasterization();
+  failures += test_edge_buffer();
+  failures += test_outlined_fill();
+  failures += test_solid_edges();
+  failures += test_fill_span();
+  failures += test_pipelined_frames();
+
+  if (failures > 0)
+  {
+    std::cout << "Total failures : " << failures << std::endl;
+    std::cout << "THE TEST FAILED!!" << std::endl;
+    return 1;
+  }
+  else
+  {
+    std::cout << "Success!" << std::endl;
+    return 0;
+  }
+}
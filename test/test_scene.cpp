@@ -1,69 +1,114 @@
+#include "obj_loader.h"
 #include "scene.h"
-#include <fstream>
-#include <regex>
+#include "window_target.h"
+#include <chrono>
 
 using namespace std;
 
+// Usage: test_scene [--headless N] [--solid|--edges] [--scanline] [--threads N] [--frames-in-flight N] [--output image.ppm|image.png] file.obj...
+//
+// With --headless, renders N frames in memory (no display needed), reports the time
+// taken and optionally writes the last frame in an image file. With --edges, faces are
+// filled with their edges in one pass (see DrawMode). With --scanline, filled
+// triangles use the scanline rasterizer instead of the edge function one. --threads sets the
+// number of threads of the job system (vertex and cull stages, tiled rasterizer).
+// --frames-in-flight sets the most frames between the geometry and raster stages (1 draws
+// each frame in a single stage).
 int main(int argc, char *argv[])
 {
   vector<Shape*> shapes;
-  Scene s = Scene();
+  vector<string> files;
+  uint headless_frames = 0;
+  bool solid_mode = false;
+  bool edges_mode = false;
+  bool scanline_mode = false;
+  uint threads = 1;
+  uint frames_in_flight = 2;
+  string output;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    string arg = argv[i];
+    if (arg == "--headless" && i + 1 < argc)
+      headless_frames = stoul(argv[++i]);
+    else if (arg == "--solid")
+      solid_mode = true;
+    else if (arg == "--edges")
+      edges_mode = true;
+    else if (arg == "--scanline")
+      scanline_mode = true;
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = stoul(argv[++i]);
+    else if (arg == "--frames-in-flight" && i + 1 < argc)
+      frames_in_flight = stoul(argv[++i]);
+    else if (arg == "--output" && i + 1 < argc)
+      output = argv[++i];
+    else
+      files.push_back(arg);
+  }
+
+  RenderTarget *target;
+  if (headless_frames > 0)
+    target = new MemoryTarget(WINDOW_WIDTH, WINDOW_HEIGHT);
+  else
+    target = new WindowTarget("FMJ - Rasterizer", WINDOW_WIDTH, WINDOW_HEIGHT, "fonts/FreeMonoBold.ttf");
+
+  Scene s(target);
   s.initialise();
+  if (solid_mode)
+    s.change_draw_mode();
+  if (edges_mode)
+    s.set_draw_mode(solid_edges);
+  if (scanline_mode)
+    s.set_fill_mode(scanline);
+  s.set_thread_count(threads);
+  s.set_max_frames_in_flight(frames_in_flight);
 
   // load object from file
-  for (int i = 1; i < argc; ++i)
+  for (const string &file : files)
   {
-    ifstream f(argv[i]);
-    string str;
-    vector<Vertex> verts;
-    vector<Face> faces;
-    while (f.good())
+    Mesh mesh;
+    if (!load_obj(file, mesh))
     {
-      getline(f, str);
-
-      if (str[0] == 'f')
-      {
-        vector<uint> ids;
-        istringstream iss(str);
-        char pass; // pass the 'v'
-        iss >> pass;
-        do
-        {
-          uint subs;
-          iss >> subs;
-          ids.push_back(subs);
-        } while (iss);
-        faces.push_back(Face(ids[0] - 1, ids[1] - 1, ids[2] - 1, minwin::WHITE));
-      }
-      else if (str[0] == 'v')
-      {
-        vector<aline::real> values;
-        istringstream iss(str);
-        char pass; // pass the 'v'
-        iss >> pass;
-        do
-        {
-          aline::real subs;
-          iss >> subs;
-          values.push_back(subs);
-        } while (iss);
-        verts.push_back(Vertex(aline::Vec3r({values[0], values[1], values[2]}), 1.0));
-      }
+      cerr << "Couldn't read " << file << endl;
+      continue;
     }
 
-    shapes.push_back(new Shape(argv[i], verts, faces));
+    shapes.push_back(new Shape(file, mesh));
 
     aline::real z_translate = 3000.0;
-    if(regex_match(argv[i], regex(".*tetrahedron.*"))){
+    if (file.find("tetrahedron") != string::npos)
       z_translate = 100.0;
-    }
 
     Object o(shapes[shapes.size()-1], {0.0, 0.0, z_translate}, {0.0, 0.0, 0.0},  {1.0, 1.0, 1.0});
     s.add_object(o);
   }
 
-  s.run();
+  auto start = chrono::steady_clock::now();
+  s.run(headless_frames);
+  auto end = chrono::steady_clock::now();
+
+  if (headless_frames > 0)
+  {
+    double ms = chrono::duration<double, milli>(end - start).count();
+    cout << "Rendered " << s.get_frame_count() << " frames in " << ms << " ms ("
+         << ms / s.get_frame_count() << " ms per frame)" << endl;
+    cout << "Matrix builds in the last frame: " << s.get_stats().matrix_builds << endl;
+    cout << "Changed objects in the last frame: " << s.get_stats().changed_objects << endl;
+    cout << "Vertex transforms in the last frame: " << s.get_stats().vertex_transforms << endl;
+    cout << "Culled triangles in the last frame: " << s.get_stats().culled_triangles << endl;
+    cout << "Culled objects in the last frame: " << s.get_stats().culled_objects << endl;
+    cout << "Clipped triangles in the last frame: " << s.get_stats().clipped_triangles << endl;
+    cout << "Rejected triangles in the last frame: " << s.get_stats().rejected_triangles << endl;
+    cout << "Drawn lines in the last frame: " << s.get_stats().drawn_lines << endl;
+
+    MemoryTarget *memory = static_cast<MemoryTarget*>(target);
+    bool png = output.size() > 4 && output.compare(output.size() - 4, 4, ".png") == 0;
+    if (!output.empty() && !(png ? memory->write_png(output) : memory->write_ppm(output)))
+      cerr << "Couldn't write " << output << endl;
+  }
 
+  delete target;
   for(Shape* p: shapes){
     delete p;
   }